@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include "accounting.h"
+
+#define PROCESS_STAT_LEN 1024
+#define PROCESS_STATUS_LEN 1024
+
+bool initProcessTable(ProcessTable *table, int capacity);
+bool growProcessTable(ProcessTable *table);
+ProcessSlot *findProcess(ProcessTable *table, pid_t pid);
+bool addProcess(ProcessTable *table, ProcessSlot *process);
+UserSlot *findUser(Accounting *accounting, uid_t uid);
+bool growUsers(Accounting *accounting);
+void touchUser(Accounting *accounting, UserSlot *user);
+bool readProcess(int procFd, const char *name, ProcessSlot *process, unsigned long long *rss, uid_t *uid);
+bool readProcessUID(int procFd, const char *name, uid_t *uid);
+unsigned int hashKey(unsigned int key, int capacity);
+
+// every pass reads /proc/<pid>/stat and /proc/<pid>/status once for each process, and adds its
+// cpu time since the last pass, rss, and itself to the user that owns it. both tables are open
+// addressing with linear probing, and are only allocated again when they grow, so a pass costs
+// the same every time
+
+bool initAccounting(Accounting *accounting) {
+
+  memset(accounting, 0, sizeof(Accounting));
+
+  accounting -> proc = opendir("/proc");
+
+  if (accounting -> proc == NULL) {
+    perror("Error fetching user usage... /proc cannot be opened");
+    return false;
+  }
+
+  accounting -> users = calloc(ACCOUNTING_USER_SLOTS, sizeof(UserSlot));
+  accounting -> userCapacity = ACCOUNTING_USER_SLOTS;
+
+  if (accounting -> users == NULL || !initProcessTable(&(accounting -> current), ACCOUNTING_PROCESS_SLOTS) ||
+      !initProcessTable(&(accounting -> last), ACCOUNTING_PROCESS_SLOTS)) {
+    perror("Error fetching user usage... calloc");
+    freeAccounting(accounting);
+    return false;
+  }
+
+  accounting -> ticksPerSecond = sysconf(_SC_CLK_TCK);
+  accounting -> pageKB = sysconf(_SC_PAGESIZE) / 1024;
+  accounting -> cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return true;
+
+}
+
+void freeAccounting(Accounting *accounting) {
+
+  if (accounting -> proc != NULL) {
+    closedir(accounting -> proc);
+  }
+
+  free(accounting -> current.slots);
+  free(accounting -> last.slots);
+  free(accounting -> users);
+
+  memset(accounting, 0, sizeof(Accounting));
+
+}
+
+void updateAccounting(Accounting *accounting) {
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  double elapsed = (double) (now.tv_sec - accounting -> lastTime.tv_sec) + (double) (now.tv_nsec - accounting -> lastTime.tv_nsec) / 1000000000.0;
+
+  bool first = accounting -> pass == 0;
+
+  // users are reset the first time they are touched in a pass, so nothing is cleared up front
+  accounting -> pass++;
+
+  // this pass is compared against the last one, and reuses the table from the one before
+  ProcessTable table = accounting -> last;
+  accounting -> last = accounting -> current;
+  accounting -> current = table;
+
+  memset(accounting -> current.slots, 0, accounting -> current.capacity * sizeof(ProcessSlot));
+  accounting -> current.count = 0;
+
+  rewinddir(accounting -> proc);
+
+  int procFd = dirfd(accounting -> proc);
+  struct dirent *entry;
+
+  while ((entry = readdir(accounting -> proc)) != NULL) {
+
+    // only processes are numbered
+    if (entry -> d_name[0] < '1' || entry -> d_name[0] > '9') {
+      continue;
+    }
+
+    ProcessSlot process;
+    unsigned long long rss;
+    uid_t uid;
+
+    // it exited since we listed it
+    if (!readProcess(procFd, entry -> d_name, &process, &rss, &uid)) {
+      continue;
+    }
+
+    ProcessSlot *last = findProcess(&(accounting -> last), process.pid);
+
+    unsigned long long used = 0;
+
+    if (last != NULL && last -> startTime == process.startTime) {
+      used = process.cpuTime - last -> cpuTime;
+    } else if (!first) {
+      // it started since the last pass, so all of its time is new
+      used = process.cpuTime;
+    }
+
+    addProcess(&(accounting -> current), &process);
+
+    UserSlot *user = findUser(accounting, uid);
+
+    if (user == NULL) {
+      continue;
+    }
+
+    user -> processes++;
+    user -> rss += rss * accounting -> pageKB;
+    user -> cpu += (double) used;
+
+  }
+
+  // jiffies to percent of all cpus, the first pass only has the baseline
+  double available = first ? 0.0 : elapsed * accounting -> ticksPerSecond * accounting -> cpus;
+
+  for (int i = 0; i < accounting -> userCapacity; i++) {
+
+    UserSlot *user = &(accounting -> users[i]);
+
+    if (user -> used && user -> pass == accounting -> pass) {
+      user -> cpu = available > 0.0 ? user -> cpu / available * 100.0 : 0.0;
+    }
+
+  }
+
+  accounting -> lastTime = now;
+
+}
+
+void addAccountingSession(Accounting *accounting, const char *name) {
+
+  // there are only ever a few users, so look for the name before asking the password database
+  for (int i = 0; i < accounting -> userCapacity; i++) {
+
+    UserSlot *user = &(accounting -> users[i]);
+
+    if (user -> used && strncmp(user -> name, name, ACCOUNTING_NAME_LEN) == 0) {
+      touchUser(accounting, user);
+      user -> sessions++;
+      return;
+    }
+
+  }
+
+  struct passwd *password = getpwnam(name);
+
+  if (password == NULL) {
+    return;
+  }
+
+  UserSlot *user = findUser(accounting, password -> pw_uid);
+
+  if (user != NULL) {
+    user -> sessions++;
+  }
+
+}
+
+// fills top with the users using the most cpu, or memory during the first pass, and returns how many
+int getTopUsers(Accounting *accounting, UserSlot **top, int count) {
+
+  int found = 0;
+
+  for (int i = 0; i < accounting -> userCapacity; i++) {
+
+    UserSlot *user = &(accounting -> users[i]);
+
+    if (!user -> used || user -> pass != accounting -> pass) {
+      continue;
+    }
+
+    // insertion into a short sorted list, dropping whatever falls off the end
+    int j = found < count ? found++ : count;
+
+    while (j > 0 && (user -> cpu > top[j - 1] -> cpu ||
+           (user -> cpu == top[j - 1] -> cpu && user -> rss > top[j - 1] -> rss))) {
+
+      if (j < count) {
+        top[j] = top[j - 1];
+      }
+
+      j--;
+
+    }
+
+    if (j < count) {
+      top[j] = user;
+    }
+
+  }
+
+  return found;
+
+}
+
+bool initProcessTable(ProcessTable *table, int capacity) {
+
+  table -> slots = calloc(capacity, sizeof(ProcessSlot));
+  table -> capacity = capacity;
+  table -> count = 0;
+
+  return table -> slots != NULL;
+
+}
+
+bool growProcessTable(ProcessTable *table) {
+
+  ProcessTable grown;
+
+  if (!initProcessTable(&grown, table -> capacity * 2)) {
+    perror("Error fetching user usage... calloc");
+    return false;
+  }
+
+  for (int i = 0; i < table -> capacity; i++) {
+    if (table -> slots[i].pid != 0) {
+      addProcess(&grown, &(table -> slots[i]));
+    }
+  }
+
+  free(table -> slots);
+  *table = grown;
+
+  return true;
+
+}
+
+ProcessSlot *findProcess(ProcessTable *table, pid_t pid) {
+
+  unsigned int mask = table -> capacity - 1;
+
+  for (unsigned int i = hashKey(pid, table -> capacity); table -> slots[i].pid != 0; i = (i + 1) & mask) {
+    if (table -> slots[i].pid == pid) {
+      return &(table -> slots[i]);
+    }
+  }
+
+  return NULL;
+
+}
+
+bool addProcess(ProcessTable *table, ProcessSlot *process) {
+
+  // keep it at most half full so probes stay short
+  if ((table -> count + 1) * 2 > table -> capacity && !growProcessTable(table)) {
+    return false;
+  }
+
+  unsigned int mask = table -> capacity - 1;
+  unsigned int i = hashKey(process -> pid, table -> capacity);
+
+  while (table -> slots[i].pid != 0) {
+    i = (i + 1) & mask;
+  }
+
+  table -> slots[i] = *process;
+  table -> count++;
+
+  return true;
+
+}
+
+UserSlot *findUser(Accounting *accounting, uid_t uid) {
+
+  if ((accounting -> userCount + 1) * 2 > accounting -> userCapacity && !growUsers(accounting)) {
+    return NULL;
+  }
+
+  unsigned int mask = accounting -> userCapacity - 1;
+  unsigned int i = hashKey(uid, accounting -> userCapacity);
+
+  while (accounting -> users[i].used && accounting -> users[i].uid != uid) {
+    i = (i + 1) & mask;
+  }
+
+  UserSlot *user = &(accounting -> users[i]);
+
+  // users are never removed, so the name is only looked up the first time we see them
+  if (!user -> used) {
+
+    user -> used = true;
+    user -> uid = uid;
+
+    struct passwd *password = getpwuid(uid);
+
+    if (password != NULL) {
+      snprintf(user -> name, sizeof(user -> name), "%s", password -> pw_name);
+    } else {
+      snprintf(user -> name, sizeof(user -> name), "%u", (unsigned int) uid);
+    }
+
+    accounting -> userCount++;
+
+  }
+
+  touchUser(accounting, user);
+
+  return user;
+
+}
+
+bool growUsers(Accounting *accounting) {
+
+  int capacity = accounting -> userCapacity * 2;
+  UserSlot *users = calloc(capacity, sizeof(UserSlot));
+
+  if (users == NULL) {
+    perror("Error fetching user usage... calloc");
+    return false;
+  }
+
+  unsigned int mask = capacity - 1;
+
+  for (int i = 0; i < accounting -> userCapacity; i++) {
+
+    if (!accounting -> users[i].used) {
+      continue;
+    }
+
+    unsigned int j = hashKey(accounting -> users[i].uid, capacity);
+
+    while (users[j].used) {
+      j = (j + 1) & mask;
+    }
+
+    users[j] = accounting -> users[i];
+
+  }
+
+  free(accounting -> users);
+
+  accounting -> users = users;
+  accounting -> userCapacity = capacity;
+
+  return true;
+
+}
+
+void touchUser(Accounting *accounting, UserSlot *user) {
+
+  if (user -> pass == accounting -> pass) {
+    return;
+  }
+
+  user -> pass = accounting -> pass;
+  user -> processes = 0;
+  user -> sessions = 0;
+  user -> cpu = 0.0;
+  user -> rss = 0;
+
+}
+
+// reads the pid, start time, cpu time, and rss of a process, and the uid that owns it
+bool readProcess(int procFd, const char *name, ProcessSlot *process, unsigned long long *rss, uid_t *uid) {
+
+  char path[64];
+  snprintf(path, sizeof(path), "%s/stat", name);
+
+  int fd = openat(procFd, path, O_RDONLY | O_CLOEXEC);
+
+  if (fd == -1) {
+    return false;
+  }
+
+  char line[PROCESS_STAT_LEN];
+  int length = read(fd, line, sizeof(line) - 1);
+
+  close(fd);
+
+  if (length <= 0) {
+    return false;
+  }
+
+  line[length] = '\0';
+
+  // the name can have spaces and brackets in it, so start after the last ')'
+  char *fields = strrchr(line, ')');
+
+  if (fields == NULL) {
+    return false;
+  }
+
+  unsigned long long userTime;
+  unsigned long long systemTime;
+
+  // fields 3 to 24 of proc(5), we want utime, stime, starttime, and rss
+  int matched = sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %llu %*u %llu",
+                    &userTime, &systemTime, &(process -> startTime), rss);
+
+  if (matched != 4) {
+    return false;
+  }
+
+  process -> pid = strtol(name, NULL, 10);
+  process -> cpuTime = userTime + systemTime;
+
+  return readProcessUID(procFd, name, uid);
+
+}
+
+// the real uid of a process, from /proc/<pid>/status. the owner of the files in /proc/<pid> is the
+// effective uid instead, or root if the process can't be dumped, so setuid programs and daemons
+// that dropped privileges would be counted for the wrong user
+bool readProcessUID(int procFd, const char *name, uid_t *uid) {
+
+  char path[64];
+  snprintf(path, sizeof(path), "%s/status", name);
+
+  int fd = openat(procFd, path, O_RDONLY | O_CLOEXEC);
+
+  if (fd == -1) {
+    return false;
+  }
+
+  // Uid: is within the first few lines, so the rest of the file is never read
+  char status[PROCESS_STATUS_LEN];
+  int length = read(fd, status, sizeof(status) - 1);
+
+  close(fd);
+
+  if (length <= 0) {
+    return false;
+  }
+
+  status[length] = '\0';
+
+  // real, effective, saved, and filesystem uid
+  char *line = strstr(status, "\nUid:");
+  unsigned int real;
+
+  if (line == NULL || sscanf(line, "\nUid: %u", &real) != 1) {
+    return false;
+  }
+
+  *uid = real;
+
+  return true;
+
+}
+
+unsigned int hashKey(unsigned int key, int capacity) {
+  // multiplicative hashing, pids and uids are mostly sequential
+  return (key * 2654435761u) & (capacity - 1);
+}
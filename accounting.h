@@ -0,0 +1,54 @@
+#include <stdbool.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+
+// slots the tables start with, both are powers of 2 and double when half full
+#define ACCOUNTING_PROCESS_SLOTS 1024
+#define ACCOUNTING_USER_SLOTS 64
+
+#define ACCOUNTING_NAME_LEN 32
+
+// what a process had used as of the last pass, to turn its total cpu time into a rate
+typedef struct processSlot {
+  pid_t pid; // 0 when empty
+  unsigned long long startTime; // jiffies after boot, tells a reused pid apart
+  unsigned long long cpuTime; // user + system jiffies
+} ProcessSlot;
+
+typedef struct processTable {
+  ProcessSlot *slots;
+  int capacity;
+  int count;
+} ProcessTable;
+
+typedef struct userSlot {
+  bool used;
+  uid_t uid;
+  char name[ACCOUNTING_NAME_LEN];
+  unsigned long pass; // the pass the values below are from
+  int processes;
+  int sessions;
+  double cpu; // percent of all cpus
+  unsigned long long rss; // kB
+} UserSlot;
+
+typedef struct accounting {
+  DIR *proc; // kept open and rewound every pass
+  unsigned long pass;
+  ProcessTable current;
+  ProcessTable last; // the pass before, swapped with current every pass
+  UserSlot *users;
+  int userCapacity;
+  int userCount;
+  struct timespec lastTime;
+  long ticksPerSecond;
+  long pageKB;
+  int cpus;
+} Accounting;
+
+bool initAccounting(Accounting *accounting);
+void freeAccounting(Accounting *accounting);
+void updateAccounting(Accounting *accounting);
+void addAccountingSession(Accounting *accounting, const char *name);
+int getTopUsers(Accounting *accounting, UserSlot **top, int count);
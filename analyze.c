@@ -0,0 +1,978 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "process_info.h"
+#include "rules.h"
+
+// records parsed ahead of the merge for each recording, this is what keeps memory bounded
+#define RECORDING_BUFFER 1024
+
+// records parsed at a time, so one recording never holds on to a worker for long
+#define RECORDING_CHUNK 256
+
+#define RECORDING_LINE_LEN 4096
+#define HOST_LEN 64
+#define TOP_OUTLIERS 20
+
+// steps of the continued fraction in getTailProbability, it converges in far fewer
+#define BETA_STEPS 200
+
+typedef struct record {
+  int64_t time; // milliseconds since the epoch
+  double metrics[METRIC_COUNT]; // NAN if the sample didn't have it
+} Record;
+
+// one file recorded with --record, parsed by the workers and merged by the main thread
+typedef struct recording {
+  char *path;
+  FILE *file;
+  char host[HOST_LEN];
+  Record *records; // ring buffer of RECORDING_BUFFER records
+  int head; // the next record to merge
+  int count; // records parsed but not merged yet
+  bool busy; // a worker is parsing into the buffer
+  bool done; // parsed to the end of the file
+  int lineNumber;
+} Recording;
+
+// running mean and variance using welford's method, so nothing has to be kept to compute them
+typedef struct stats {
+  long count;
+  double mean;
+  double m2;
+  double min;
+  double max;
+} Stats;
+
+typedef struct host {
+  Stats metrics[METRIC_COUNT];
+  double window[METRIC_COUNT]; // latest value in the current window, NAN if there wasn't one
+  int outliers[METRIC_COUNT]; // windows where it was over the threshold
+  double maxScore[METRIC_COUNT];
+  int64_t maxScoreTime[METRIC_COUNT];
+} Host;
+
+typedef struct analysis {
+  Recording *recordings;
+  Host *hosts;
+  int count;
+  int64_t window; // milliseconds every host is lined up to
+  double threshold; // z-score that makes a host an outlier
+  double *critical; // leave-one-out score with the same odds as the threshold, by the number of other hosts
+  pthread_mutex_t lock;
+  pthread_cond_t work; // a recording has room to parse more
+  pthread_cond_t filled; // a recording has more records or is done
+  Stats fleet[METRIC_COUNT]; // every sample of every host
+  double peak[METRIC_COUNT]; // highest mean of the fleet in a window
+  int64_t peakTime[METRIC_COUNT];
+  long windows;
+  long samples;
+  int64_t first;
+  int64_t last;
+} Analysis;
+
+typedef struct outlier {
+  int host;
+  int metric;
+} Outlier;
+
+int setAnalysisFlags(Analysis *analysis, int *threads, int argc, char *argv[]);
+bool initAnalysis(Analysis *analysis, char **paths, int count);
+void freeAnalysis(Analysis *analysis);
+void *parseRecordings(void *argument);
+Recording *findRecordingToParse(Analysis *analysis, bool *finished);
+int parseChunk(Recording *recording, int tail, int count, bool *end);
+bool parseRecord(char *line, Record *record, char *host);
+double parseNumber(char *string, char **end);
+void mergeRecordings(Analysis *analysis);
+bool waitForRecord(Analysis *analysis, Recording *recording);
+void consumeRecord(Analysis *analysis, Recording *recording);
+void siftDown(Analysis *analysis, int *heap, int count, int index);
+int64_t getHeadTime(Analysis *analysis, int index);
+void addRecord(Analysis *analysis, int index, Record *record);
+void closeWindow(Analysis *analysis, int64_t time);
+void updateStats(Stats *stats, double value);
+double getStddev(Stats *stats);
+double getCriticalScore(Analysis *analysis, int others);
+double getTailProbability(double t, int freedom);
+double getBetaFraction(double a, double b, double x);
+void displayReport(Analysis *analysis);
+void formatTime(char *string, int capacity, int64_t time);
+void printUsage(char *execName);
+
+// sysinfo-analyze [--window=MS] [--threshold=Z] [--threads=N] FILE...
+// merges recordings from sysinfo --record by time, and reports the fleet and the hosts that stood out
+int main(int argc, char *argv[]) {
+
+  Analysis analysis;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  int first = setAnalysisFlags(&analysis, &threads, argc, argv);
+
+  if (first == 0) {
+    return 1;
+  }
+
+  if (!initAnalysis(&analysis, argv + first, argc - first)) {
+    return 1;
+  }
+
+  // more workers than recordings would have nothing to do
+  if (threads > analysis.count) {
+    threads = analysis.count;
+  }
+
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  pthread_t workers[threads];
+  int started = 0;
+
+  for (int i = 0; i < threads; i++) {
+
+    if (pthread_create(&workers[i], NULL, parseRecordings, &analysis) != 0) {
+      perror("Error starting workers... pthread_create");
+      break;
+    }
+
+    started++;
+
+  }
+
+  if (started == 0) {
+    freeAnalysis(&analysis);
+    return 1;
+  }
+
+  mergeRecordings(&analysis);
+
+  for (int i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  displayReport(&analysis);
+
+  freeAnalysis(&analysis);
+
+  return 0;
+
+}
+
+// returns the index of the first file, or 0 if the arguments are invalid
+int setAnalysisFlags(Analysis *analysis, int *threads, int argc, char *argv[]) {
+
+  memset(analysis, 0, sizeof(Analysis));
+
+  analysis -> window = 1000;
+  analysis -> threshold = 3.0;
+
+  int i = 1;
+
+  for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+
+    char *value = strchr(argv[i], '=');
+
+    if (strcmp(argv[i], "--help") == 0 || value == NULL) {
+      printUsage(argv[0]);
+      return 0;
+    }
+
+    value++;
+
+    if (strncmp(argv[i], "--window=", 9) == 0 && strtol(value, NULL, 10) > 0) {
+      analysis -> window = strtol(value, NULL, 10);
+    } else if (strncmp(argv[i], "--threshold=", 12) == 0 && strtod(value, NULL) > 0.0) {
+      analysis -> threshold = strtod(value, NULL);
+    } else if (strncmp(argv[i], "--threads=", 10) == 0 && strtol(value, NULL, 10) > 0) {
+      *threads = strtol(value, NULL, 10);
+    } else {
+      printUsage(argv[0]);
+      return 0;
+    }
+
+  }
+
+  if (i == argc) {
+    printUsage(argv[0]);
+    return 0;
+  }
+
+  return i;
+
+}
+
+bool initAnalysis(Analysis *analysis, char **paths, int count) {
+
+  analysis -> recordings = calloc(count, sizeof(Recording));
+  analysis -> hosts = calloc(count, sizeof(Host));
+  analysis -> critical = malloc((count + 1) * sizeof(double));
+
+  if (analysis -> recordings == NULL || analysis -> hosts == NULL || analysis -> critical == NULL) {
+    perror("Error starting analysis... calloc");
+    freeAnalysis(analysis);
+    return false;
+  }
+
+  analysis -> count = count;
+
+  for (int i = 0; i < count; i++) {
+
+    Recording *recording = &(analysis -> recordings[i]);
+
+    recording -> path = paths[i];
+    recording -> file = fopen(paths[i], "r");
+    recording -> records = malloc(RECORDING_BUFFER * sizeof(Record));
+
+    if (recording -> file == NULL) {
+      fprintf(stderr, "Error starting analysis... %s cannot be opened\n", paths[i]);
+      freeAnalysis(analysis);
+      return false;
+    }
+
+    if (recording -> records == NULL) {
+      perror("Error starting analysis... malloc");
+      freeAnalysis(analysis);
+      return false;
+    }
+
+    for (int j = 0; j < METRIC_COUNT; j++) {
+      analysis -> hosts[i].window[j] = NAN;
+    }
+
+  }
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    analysis -> peak[i] = NAN;
+  }
+
+  // found the first time a window has that many hosts
+  for (int i = 0; i <= count; i++) {
+    analysis -> critical[i] = NAN;
+  }
+
+  pthread_mutex_init(&(analysis -> lock), NULL);
+  pthread_cond_init(&(analysis -> work), NULL);
+  pthread_cond_init(&(analysis -> filled), NULL);
+
+  return true;
+
+}
+
+void freeAnalysis(Analysis *analysis) {
+
+  for (int i = 0; analysis -> recordings != NULL && i < analysis -> count; i++) {
+
+    if (analysis -> recordings[i].file != NULL) {
+      fclose(analysis -> recordings[i].file);
+    }
+
+    free(analysis -> recordings[i].records);
+
+  }
+
+  free(analysis -> recordings);
+  free(analysis -> hosts);
+  free(analysis -> critical);
+
+  analysis -> recordings = NULL;
+  analysis -> hosts = NULL;
+  analysis -> critical = NULL;
+
+}
+
+// a worker parses whichever recording needs it most until every file is read
+void *parseRecordings(void *argument) {
+
+  Analysis *analysis = argument;
+
+  pthread_mutex_lock(&(analysis -> lock));
+
+  while (true) {
+
+    bool finished;
+    Recording *recording = findRecordingToParse(analysis, &finished);
+
+    if (finished) {
+      break;
+    }
+
+    if (recording == NULL) {
+      pthread_cond_wait(&(analysis -> work), &(analysis -> lock));
+      continue;
+    }
+
+    recording -> busy = true;
+
+    // the merge only moves the head forward, so the tail stays where it is while we write past it
+    int tail = (recording -> head + recording -> count) % RECORDING_BUFFER;
+
+    pthread_mutex_unlock(&(analysis -> lock));
+
+    bool end = false;
+    int parsed = parseChunk(recording, tail, RECORDING_CHUNK, &end);
+
+    pthread_mutex_lock(&(analysis -> lock));
+
+    recording -> count += parsed;
+    recording -> busy = false;
+    recording -> done = end;
+
+    pthread_cond_broadcast(&(analysis -> filled));
+
+    // the other workers need to find out once there is nothing left to parse
+    if (end) {
+      pthread_cond_broadcast(&(analysis -> work));
+    }
+
+  }
+
+  pthread_mutex_unlock(&(analysis -> lock));
+
+  return NULL;
+
+}
+
+// the recording with the fewest records that has room for a chunk, since the merge is most likely
+// waiting on it. finished is set once there is nothing left to parse at all
+Recording *findRecordingToParse(Analysis *analysis, bool *finished) {
+
+  Recording *emptiest = NULL;
+
+  *finished = true;
+
+  for (int i = 0; i < analysis -> count; i++) {
+
+    Recording *recording = &(analysis -> recordings[i]);
+
+    if (recording -> done) {
+      continue;
+    }
+
+    *finished = false;
+
+    if (recording -> busy || recording -> count > RECORDING_BUFFER - RECORDING_CHUNK) {
+      continue;
+    }
+
+    if (emptiest == NULL || recording -> count < emptiest -> count) {
+      emptiest = recording;
+    }
+
+  }
+
+  return emptiest;
+
+}
+
+int parseChunk(Recording *recording, int tail, int count, bool *end) {
+
+  char line[RECORDING_LINE_LEN];
+  int parsed = 0;
+
+  while (parsed < count) {
+
+    if (fgets(line, sizeof(line), recording -> file) == NULL) {
+      *end = true;
+      break;
+    }
+
+    recording -> lineNumber++;
+
+    Record *record = &(recording -> records[(tail + parsed) % RECORDING_BUFFER]);
+
+    // the host is the same on every line, so only the first one is kept
+    char host[HOST_LEN] = "";
+
+    if (!parseRecord(line, record, host)) {
+      fprintf(stderr, "Skipping %s line %d... not a sample\n", recording -> path, recording -> lineNumber);
+      continue;
+    }
+
+    if (recording -> host[0] == '\0') {
+      strcpy(recording -> host, host[0] != '\0' ? host : recording -> path);
+    }
+
+    parsed++;
+
+  }
+
+  return parsed;
+
+}
+
+// parses one line written by --record. only what it writes is understood, a flat object of
+// numbers with a string host, so this doesn't need to handle json in general
+bool parseRecord(char *line, Record *record, char *host) {
+
+  record -> time = -1;
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    record -> metrics[i] = NAN;
+  }
+
+  char *cursor = strchr(line, '{');
+
+  while (cursor != NULL && (cursor = strchr(cursor, '"')) != NULL) {
+
+    char *key = cursor + 1;
+    char *keyEnd = strchr(key, '"');
+
+    if (keyEnd == NULL) {
+      return false;
+    }
+
+    *keyEnd = '\0';
+
+    cursor = keyEnd + 1 + strspn(keyEnd + 1, " \t:");
+
+    if (*cursor == '"') {
+
+      // a string, only the host has one
+      char *value = cursor + 1;
+      char *valueEnd = value;
+
+      while (*valueEnd != '\0' && *valueEnd != '"') {
+        valueEnd += *valueEnd == '\\' && valueEnd[1] != '\0' ? 2 : 1;
+      }
+
+      if (strcmp(key, "host") == 0) {
+        int length = valueEnd - value < HOST_LEN - 1 ? valueEnd - value : HOST_LEN - 1;
+        memcpy(host, value, length);
+        host[length] = '\0';
+      }
+
+      cursor = *valueEnd == '"' ? valueEnd + 1 : valueEnd;
+
+    } else if (strcmp(key, "time") == 0) {
+
+      record -> time = strtoll(cursor, &cursor, 10);
+
+    } else {
+
+      char *end;
+      double value = parseNumber(cursor, &end);
+      int metric = getMetricIndex(key);
+
+      // null, or a metric from a newer version
+      if (end != cursor && metric != -1) {
+        record -> metrics[metric] = value;
+      }
+
+      cursor = end;
+
+    }
+
+    cursor = strpbrk(cursor, ",}");
+
+  }
+
+  return record -> time >= 0;
+
+}
+
+// --record writes plain decimals like 12.3456, which are read here digit by digit since strtod is
+// most of the time spent parsing. anything else, like exponents or too many digits, goes to strtod
+double parseNumber(char *string, char **end) {
+
+  char *cursor = string;
+  bool negative = *cursor == '-';
+
+  if (negative) {
+    cursor++;
+  }
+
+  unsigned long long digits = 0;
+  int count = 0;
+  int decimals = 0;
+
+  for (; *cursor >= '0' && *cursor <= '9'; cursor++, count++) {
+    digits = digits * 10 + (*cursor - '0');
+  }
+
+  if (*cursor == '.') {
+    for (cursor++; *cursor >= '0' && *cursor <= '9'; cursor++, count++, decimals++) {
+      digits = digits * 10 + (*cursor - '0');
+    }
+  }
+
+  // 2^53 and 10^15 are both exact, so 15 digits or less divide to the closest double
+  if (count == 0 || count > 15 || *cursor == 'e' || *cursor == 'E') {
+    return strtod(string, end);
+  }
+
+  static const double POWERS[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+
+  *end = cursor;
+
+  double value = (double) digits / POWERS[decimals];
+
+  return negative ? -value : value;
+
+}
+
+// a k-way merge of every recording, using a min heap on the time of the next record in each
+void mergeRecordings(Analysis *analysis) {
+
+  int heap[analysis -> count];
+  int count = 0;
+
+  for (int i = 0; i < analysis -> count; i++) {
+    if (waitForRecord(analysis, &(analysis -> recordings[i]))) {
+      heap[count++] = i;
+    }
+  }
+
+  for (int i = count / 2 - 1; i >= 0; i--) {
+    siftDown(analysis, heap, count, i);
+  }
+
+  int64_t window = 0;
+
+  while (count > 0) {
+
+    int index = heap[0];
+    Recording *recording = &(analysis -> recordings[index]);
+
+    Record *record = &(recording -> records[recording -> head]);
+
+    // every host's values in a window are compared once the merge has passed it
+    if (analysis -> samples > 0 && record -> time / analysis -> window != window) {
+      closeWindow(analysis, window * analysis -> window);
+    }
+
+    window = record -> time / analysis -> window;
+
+    addRecord(analysis, index, record);
+    consumeRecord(analysis, recording);
+
+    // take it out of the heap once it runs out, otherwise its next record goes where it was
+    if (!waitForRecord(analysis, recording)) {
+      heap[0] = heap[--count];
+    }
+
+    siftDown(analysis, heap, count, 0);
+
+  }
+
+  if (analysis -> samples > 0) {
+    closeWindow(analysis, window * analysis -> window);
+  }
+
+}
+
+// false once the recording has been read to the end and merged
+bool waitForRecord(Analysis *analysis, Recording *recording) {
+
+  pthread_mutex_lock(&(analysis -> lock));
+
+  while (recording -> count == 0 && !recording -> done) {
+    pthread_cond_wait(&(analysis -> filled), &(analysis -> lock));
+  }
+
+  bool available = recording -> count > 0;
+
+  pthread_mutex_unlock(&(analysis -> lock));
+
+  return available;
+
+}
+
+void consumeRecord(Analysis *analysis, Recording *recording) {
+
+  pthread_mutex_lock(&(analysis -> lock));
+
+  recording -> head = (recording -> head + 1) % RECORDING_BUFFER;
+  recording -> count--;
+
+  // only wake the workers once there is room for a whole chunk
+  if (recording -> count == RECORDING_BUFFER - RECORDING_CHUNK) {
+    pthread_cond_broadcast(&(analysis -> work));
+  }
+
+  pthread_mutex_unlock(&(analysis -> lock));
+
+}
+
+void siftDown(Analysis *analysis, int *heap, int count, int index) {
+
+  while (true) {
+
+    int smallest = index;
+    int left = 2 * index + 1;
+    int right = left + 1;
+
+    if (left < count && getHeadTime(analysis, heap[left]) < getHeadTime(analysis, heap[smallest])) {
+      smallest = left;
+    }
+
+    if (right < count && getHeadTime(analysis, heap[right]) < getHeadTime(analysis, heap[smallest])) {
+      smallest = right;
+    }
+
+    if (smallest == index) {
+      return;
+    }
+
+    int swap = heap[index];
+    heap[index] = heap[smallest];
+    heap[smallest] = swap;
+
+    index = smallest;
+
+  }
+
+}
+
+int64_t getHeadTime(Analysis *analysis, int index) {
+  Recording *recording = &(analysis -> recordings[index]);
+  return recording -> records[recording -> head].time;
+}
+
+void addRecord(Analysis *analysis, int index, Record *record) {
+
+  Host *host = &(analysis -> hosts[index]);
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+
+    double value = record -> metrics[i];
+
+    if (isnan(value)) {
+      continue;
+    }
+
+    updateStats(&(host -> metrics[i]), value);
+    updateStats(&(analysis -> fleet[i]), value);
+
+    // a host sampling faster than the window is represented by its latest value
+    host -> window[i] = value;
+
+  }
+
+  if (analysis -> samples == 0) {
+    analysis -> first = record -> time;
+  }
+
+  analysis -> last = record -> time;
+  analysis -> samples++;
+
+}
+
+// compares every host to the rest of the fleet in the window. each host is left out of the mean
+// and stddev it is compared to, otherwise it pulls them towards itself and a small fleet can never
+// have an outlier
+void closeWindow(Analysis *analysis, int64_t time) {
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+
+    int count = 0;
+    double sum = 0.0;
+    double squares = 0.0;
+
+    for (int j = 0; j < analysis -> count; j++) {
+
+      double value = analysis -> hosts[j].window[i];
+
+      if (!isnan(value)) {
+        count++;
+        sum += value;
+        squares += value * value;
+      }
+
+    }
+
+    if (count == 0) {
+      continue;
+    }
+
+    double mean = sum / count;
+
+    if (isnan(analysis -> peak[i]) || mean > analysis -> peak[i]) {
+      analysis -> peak[i] = mean;
+      analysis -> peakTime[i] = time;
+    }
+
+    for (int j = 0; j < analysis -> count; j++) {
+
+      Host *host = &(analysis -> hosts[j]);
+      double value = host -> window[i];
+
+      host -> window[i] = NAN;
+
+      // a stddev of the others needs at least 2 of them
+      if (isnan(value) || count < 3) {
+        continue;
+      }
+
+      double othersMean = (sum - value) / (count - 1);
+      double othersVariance = (squares - value * value - (count - 1) * othersMean * othersMean) / (count - 2);
+
+      // every other host had the same value, ie. memory_total on identical machines
+      if (othersVariance < 1e-12) {
+        continue;
+      }
+
+      // with only a few others their stddev is often well under the real one, so the score is
+      // scaled to the z-score with the same odds, and a fleet of 5 is flagged as often as one of 500
+      double score = fabs(value - othersMean) / sqrt(othersVariance) * analysis -> threshold / getCriticalScore(analysis, count - 1);
+
+      if (score > analysis -> threshold) {
+        host -> outliers[i]++;
+      }
+
+      if (score > host -> maxScore[i]) {
+        host -> maxScore[i] = score;
+        host -> maxScoreTime[i] = time;
+      }
+
+    }
+
+  }
+
+  analysis -> windows++;
+
+}
+
+void updateStats(Stats *stats, double value) {
+
+  stats -> count++;
+
+  if (stats -> count == 1) {
+    stats -> min = value;
+    stats -> max = value;
+  }
+
+  stats -> min = fmin(stats -> min, value);
+  stats -> max = fmax(stats -> max, value);
+
+  double delta = value - stats -> mean;
+
+  stats -> mean += delta / stats -> count;
+  stats -> m2 += delta * (value - stats -> mean);
+
+}
+
+double getStddev(Stats *stats) {
+  return stats -> count > 1 ? sqrt(stats -> m2 / (stats -> count - 1)) : 0.0;
+}
+
+// the leave-one-out score of a host over the others follows a t distribution with others - 1
+// degrees of freedom, widened by the error in their mean. this finds the score that is as unlikely
+// as the threshold is for a normal distribution, by bisection since it only runs once for each count
+double getCriticalScore(Analysis *analysis, int others) {
+
+  if (!isnan(analysis -> critical[others])) {
+    return analysis -> critical[others];
+  }
+
+  // the odds of a normal value being further than the threshold from the mean, either way
+  double tail = erfc(analysis -> threshold / sqrt(2.0));
+
+  double low = 0.0;
+  double high = analysis -> threshold;
+
+  while (high < 1e300 && getTailProbability(high, others - 1) > tail) {
+    low = high;
+    high *= 2.0;
+  }
+
+  for (int i = 0; i < 100 && high - low > 1e-9 * high; i++) {
+
+    double middle = (low + high) / 2.0;
+
+    if (getTailProbability(middle, others - 1) > tail) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+
+  }
+
+  analysis -> critical[others] = high * sqrt(1.0 + 1.0 / others);
+
+  return analysis -> critical[others];
+
+}
+
+// the odds of a t distribution being further than t from 0 either way, which is the regularized
+// incomplete beta function I(freedom / (freedom + t^2); freedom / 2, 1 / 2)
+double getTailProbability(double t, int freedom) {
+
+  double a = freedom / 2.0;
+  double b = 0.5;
+  double x = freedom / (freedom + t * t);
+  double y = t * t / (freedom + t * t);
+
+  double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(y));
+
+  // the fraction only converges quickly on one side, so the other uses I(x; a, b) = 1 - I(1 - x; b, a)
+  if (x < (a + 1.0) / (a + b + 2.0)) {
+    return front * getBetaFraction(a, b, x) / a;
+  }
+
+  return 1.0 - front * getBetaFraction(b, a, y) / b;
+
+}
+
+// the continued fraction for the incomplete beta function, using lentz's method
+double getBetaFraction(double a, double b, double x) {
+
+  double tiny = 1e-300;
+  double c = 1.0;
+  double d = 1.0 - (a + b) * x / (a + 1.0);
+
+  d = 1.0 / (fabs(d) < tiny ? tiny : d);
+
+  double fraction = d;
+
+  for (int m = 1; m <= BETA_STEPS; m++) {
+
+    // every step has an even and an odd term
+    double even = m * (b - m) * x / ((a + 2 * m - 1.0) * (a + 2 * m));
+    double odd = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1.0));
+
+    d = 1.0 + even * d;
+    c = 1.0 + even / c;
+    d = 1.0 / (fabs(d) < tiny ? tiny : d);
+    c = fabs(c) < tiny ? tiny : c;
+    fraction *= d * c;
+
+    d = 1.0 + odd * d;
+    c = 1.0 + odd / c;
+    d = 1.0 / (fabs(d) < tiny ? tiny : d);
+    c = fabs(c) < tiny ? tiny : c;
+
+    double delta = d * c;
+    fraction *= delta;
+
+    if (fabs(delta - 1.0) < 1e-12) {
+      break;
+    }
+
+  }
+
+  return fraction;
+
+}
+
+void displayReport(Analysis *analysis) {
+
+  char from[64];
+  char to[64];
+
+  formatTime(from, sizeof(from), analysis -> first);
+  formatTime(to, sizeof(to), analysis -> last);
+
+  printf("----------Recordings------------------\n");
+  printf("Hosts: %d\n", analysis -> count);
+  printf("Samples: %ld\n", analysis -> samples);
+
+  if (analysis -> samples == 0) {
+    printf("--------------------------------------\n");
+    return;
+  }
+
+  printf("From %s to %s\n", from, to);
+  printf("Windows: %ld of %lld ms\n", analysis -> windows, (long long) analysis -> window);
+
+  printf("----------Fleet-----------------------\n");
+  printf("%-16s %10s %10s %10s %10s %10s  %s\n", "Metric", "Mean", "Stddev", "Min", "Max", "Peak", "Peak At");
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+
+    Stats *stats = &(analysis -> fleet[i]);
+
+    if (stats -> count == 0) {
+      continue;
+    }
+
+    char peakTime[64];
+    formatTime(peakTime, sizeof(peakTime), analysis -> peakTime[i]);
+
+    printf("%-16s %10.2f %10.2f %10.2f %10.2f %10.2f  %s\n", getMetricName(i), stats -> mean, getStddev(stats),
+           stats -> min, stats -> max, analysis -> peak[i], peakTime);
+
+  }
+
+  // the host and metric pairs with the most windows over the threshold, found like getTopUsers
+  Outlier top[TOP_OUTLIERS];
+  int found = 0;
+
+  for (int i = 0; i < analysis -> count; i++) {
+    for (int j = 0; j < METRIC_COUNT; j++) {
+
+      int outliers = analysis -> hosts[i].outliers[j];
+
+      if (outliers == 0) {
+        continue;
+      }
+
+      int k = found < TOP_OUTLIERS ? found++ : TOP_OUTLIERS;
+
+      while (k > 0 && outliers > analysis -> hosts[top[k - 1].host].outliers[top[k - 1].metric]) {
+
+        if (k < TOP_OUTLIERS) {
+          top[k] = top[k - 1];
+        }
+
+        k--;
+
+      }
+
+      if (k < TOP_OUTLIERS) {
+        top[k] = (Outlier) {i, j};
+      }
+
+    }
+  }
+
+  printf("----------Outliers--------------------\n");
+  printf("Windows more than %.2f stddevs from the rest of the fleet\n", analysis -> threshold);
+
+  if (found == 0) {
+    printf("None\n");
+  } else {
+    printf("%-24s %-16s %8s %10s %10s  %s\n", "Host", "Metric", "Windows", "Mean", "Max Score", "Max At");
+  }
+
+  for (int i = 0; i < found; i++) {
+
+    Host *host = &(analysis -> hosts[top[i].host]);
+    int metric = top[i].metric;
+
+    char maxTime[64];
+    formatTime(maxTime, sizeof(maxTime), host -> maxScoreTime[metric]);
+
+    printf("%-24.24s %-16s %8d %10.2f %10.2f  %s\n", analysis -> recordings[top[i].host].host, getMetricName(metric),
+           host -> outliers[metric], host -> metrics[metric].mean, host -> maxScore[metric], maxTime);
+
+  }
+
+  printf("--------------------------------------\n");
+
+}
+
+void formatTime(char *string, int capacity, int64_t time) {
+
+  time_t seconds = time / 1000;
+  struct tm local;
+
+  localtime_r(&seconds, &local);
+  strftime(string, capacity, "%Y-%m-%d %H:%M:%S", &local);
+
+}
+
+void printUsage(char *execName) {
+
+  printf("Usage: %s [--window=MS] [--threshold=Z] [--threads=N] FILE...\n", execName);
+  printf("Merges recordings from sysinfo --record=FILE by time and reports the fleet and its outliers\n");
+  printf("--window=MS (line hosts up to windows of MS milliseconds, default 1000)\n");
+  printf("--threshold=Z (how many stddevs from the rest of the fleet is an outlier, default 3)\n");
+  printf("--threads=N (parse N files at once, default the number of cpus)\n");
+
+}
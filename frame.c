@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "frame.h"
+
+// the largest value appendDouble formats itself, about 2^63
+#define FRAME_MAX_DOUBLE 9.2e18
+
+bool growFrame(Frame *frame, int length);
+
+// a frame is one buffer that every append writes to at its cursor, so adding to it never has to
+// find the end again. it is kept between samples and reset by moving the cursor back to the start,
+// so it is only allocated again when a sample is bigger than any before it
+
+bool initFrame(Frame *frame) {
+
+  frame -> data = malloc(FRAME_SIZE);
+  frame -> capacity = FRAME_SIZE;
+
+  if (frame -> data == NULL) {
+    perror("Error creating frame... malloc");
+    frame -> capacity = 0;
+  }
+
+  resetFrame(frame);
+
+  return frame -> data != NULL;
+
+}
+
+void freeFrame(Frame *frame) {
+
+  free(frame -> data);
+
+  frame -> data = NULL;
+  frame -> capacity = 0;
+  frame -> length = 0;
+
+}
+
+void resetFrame(Frame *frame) {
+
+  frame -> length = 0;
+  frame -> truncated = false;
+
+  if (frame -> data != NULL) {
+    frame -> data[0] = '\0';
+  }
+
+}
+
+// room for length bytes and a \0 at the cursor, or NULL if it would go over FRAME_MAX_SIZE.
+// the pointer is only good until the next write to the frame
+char *reserveFrame(Frame *frame, int length) {
+
+  if (frame -> length + length + 1 > frame -> capacity && !growFrame(frame, length)) {
+    frame -> truncated = true;
+    return NULL;
+  }
+
+  return frame -> data + frame -> length;
+
+}
+
+// moves the cursor past bytes written to a reserved pointer
+void commitFrame(Frame *frame, int length) {
+
+  frame -> length += length;
+  frame -> data[frame -> length] = '\0';
+
+}
+
+bool growFrame(Frame *frame, int length) {
+
+  int capacity = frame -> capacity > 0 ? frame -> capacity : FRAME_SIZE;
+
+  while (capacity < frame -> length + length + 1 && capacity < FRAME_MAX_SIZE) {
+    capacity *= 2;
+  }
+
+  if (capacity > FRAME_MAX_SIZE) {
+    capacity = FRAME_MAX_SIZE;
+  }
+
+  if (capacity < frame -> length + length + 1) {
+    return false;
+  }
+
+  char *data = realloc(frame -> data, capacity);
+
+  if (data == NULL) {
+    perror("Error growing frame... realloc");
+    return false;
+  }
+
+  frame -> data = data;
+  frame -> capacity = capacity;
+
+  return true;
+
+}
+
+void appendBytes(Frame *frame, const char *bytes, int length) {
+
+  char *cursor = reserveFrame(frame, length);
+
+  // drop the whole write instead of cutting it off partway
+  if (cursor == NULL) {
+    return;
+  }
+
+  memcpy(cursor, bytes, length);
+  commitFrame(frame, length);
+
+}
+
+void appendString(Frame *frame, const char *string) {
+  appendBytes(frame, string, strlen(string));
+}
+
+void appendChar(Frame *frame, char character) {
+  appendBytes(frame, &character, 1);
+}
+
+void appendRepeat(Frame *frame, char character, int count) {
+
+  if (count <= 0) {
+    return;
+  }
+
+  char *cursor = reserveFrame(frame, count);
+
+  if (cursor == NULL) {
+    return;
+  }
+
+  memset(cursor, character, count);
+  commitFrame(frame, count);
+
+}
+
+void appendInt(Frame *frame, long long value) {
+
+  // digits are found backwards, so write them from the end of a buffer
+  char digits[24];
+  int start = sizeof(digits);
+
+  unsigned long long magnitude = value < 0 ? -(unsigned long long) value : (unsigned long long) value;
+
+  do {
+    digits[--start] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+
+  if (value < 0) {
+    digits[--start] = '-';
+  }
+
+  appendBytes(frame, digits + start, sizeof(digits) - start);
+
+}
+
+// the same digits as %.Nf, except that -0.00 is written as 0.00
+void appendDouble(Frame *frame, double value, int decimals) {
+
+  double scale = 1.0;
+
+  for (int i = 0; i < decimals; i++) {
+    scale *= 10.0;
+  }
+
+  double product = fabs(value) * scale;
+  double scaled = round(product);
+
+  // nan, inf, and anything too big for 64 bits
+  if (!(scaled < FRAME_MAX_DOUBLE)) {
+
+    char *cursor = reserveFrame(frame, 64);
+
+    if (cursor != NULL) {
+      int length = snprintf(cursor, 64, "%.*f", decimals, value);
+      commitFrame(frame, length < 64 ? length : 63);
+    }
+
+    return;
+
+  }
+
+  unsigned long long fixed = (unsigned long long) scaled;
+
+  // the product can be off from the exact value by half a unit in the last place, which only
+  // changes how it rounds when it is that close to a tie, like 0.015 that is just under it in
+  // binary. printf rounds the exact value, so those few are left to it
+  if (fabs(product - floor(product) - 0.5) <= product * DBL_EPSILON) {
+
+    char exact[64];
+    int length = snprintf(exact, sizeof(exact), "%.*f", decimals, fabs(value));
+
+    fixed = 0;
+
+    for (int i = 0; i < length && i < (int) sizeof(exact) - 1; i++) {
+      if (exact[i] != '.') {
+        fixed = fixed * 10 + (exact[i] - '0');
+      }
+    }
+
+  }
+
+  bool negative = value < 0 && fixed > 0;
+
+  char digits[48];
+  int start = sizeof(digits);
+
+  for (int i = 0; i < decimals; i++) {
+    digits[--start] = '0' + fixed % 10;
+    fixed /= 10;
+  }
+
+  if (decimals > 0) {
+    digits[--start] = '.';
+  }
+
+  do {
+    digits[--start] = '0' + fixed % 10;
+    fixed /= 10;
+  } while (fixed > 0);
+
+  // -0.00 is just 0.00
+  if (negative) {
+    digits[--start] = '-';
+  }
+
+  appendBytes(frame, digits + start, sizeof(digits) - start);
+
+}
+
+// pads everything written since start to width with spaces, on the left for a positive width
+// and on the right for a negative one, like a field width in printf
+void alignFrame(Frame *frame, int start, int width) {
+
+  bool left = width < 0;
+  int padding = abs(width) - (frame -> length - start);
+
+  if (padding <= 0 || reserveFrame(frame, padding) == NULL) {
+    return;
+  }
+
+  if (!left) {
+    memmove(frame -> data + start + padding, frame -> data + start, frame -> length - start);
+    memset(frame -> data + start, ' ', padding);
+  } else {
+    memset(frame -> data + frame -> length, ' ', padding);
+  }
+
+  commitFrame(frame, padding);
+
+}
@@ -0,0 +1,27 @@
+#include <stdbool.h>
+
+// a frame starts at FRAME_SIZE bytes and doubles as needed, up to FRAME_MAX_SIZE
+#define FRAME_SIZE 4096
+#define FRAME_MAX_SIZE (1024 * 1024)
+
+typedef struct frame {
+  char *data; // always ends in a \0 at length
+  int length; // where the next write goes
+  int capacity;
+  bool truncated; // something didn't fit under FRAME_MAX_SIZE and was dropped
+} Frame;
+
+bool initFrame(Frame *frame);
+void freeFrame(Frame *frame);
+void resetFrame(Frame *frame);
+
+char *reserveFrame(Frame *frame, int length);
+void commitFrame(Frame *frame, int length);
+
+void appendBytes(Frame *frame, const char *bytes, int length);
+void appendString(Frame *frame, const char *string);
+void appendChar(Frame *frame, char character);
+void appendRepeat(Frame *frame, char character, int count);
+void appendInt(Frame *frame, long long value);
+void appendDouble(Frame *frame, double value, int decimals);
+void alignFrame(Frame *frame, int start, int width);
@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include "frequency.h"
+
+#define FREQUENCY_VALUE_LEN 32
+
+#define FREQUENCY_CUR_FREQ "cpufreq/scaling_cur_freq"
+#define FREQUENCY_CORE_THROTTLE "thermal_throttle/core_throttle_count"
+#define FREQUENCY_PACKAGE_THROTTLE "thermal_throttle/package_throttle_count"
+#define FREQUENCY_PACKAGE_ID "topology/physical_package_id"
+
+bool addFrequencyCPU(Frequency *frequency, int cpusFd, const char *name, int *capacity);
+FrequencySocket *findSocket(Frequency *frequency, int package, int *capacity);
+bool addThermalZone(Frequency *frequency, int zonesFd, const char *name, int *capacity);
+bool isCPUZone(const char *type);
+int openSysfs(Frequency *frequency, int dirFd, const char *name, const char *file);
+int keepSysfs(Frequency *frequency, int fd);
+void releaseSysfs(Frequency *frequency);
+void closeSysfs(int fd);
+bool readSysfs(int fd, const char *directory, const char *name, const char *file, char *value, int capacity);
+bool readSysfsValue(int fd, const char *directory, const char *name, const char *file, long long *value);
+bool isNumbered(const char *name, const char *prefix);
+
+// every file is opened once here and kept, so a pass is one pread for each of them instead of an
+// open, read, and close. anything missing, like cpufreq in a vm or thermal_throttle off intel, is
+// just left out, so a machine without any of them ends up with nothing to read. a machine with
+// hundreds of cpus could use up every fd like this, so if we get close, none of them are kept and
+// every read opens its file again
+
+bool initFrequency(Frequency *frequency) {
+
+  memset(frequency, 0, sizeof(Frequency));
+
+  struct rlimit limit;
+
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < INT_MAX) {
+    frequency -> fdLimit = (int) limit.rlim_cur - FREQUENCY_SPARE_FDS;
+  } else {
+    frequency -> fdLimit = INT_MAX;
+  }
+
+  DIR *cpus = opendir(FREQUENCY_CPU_PATH);
+
+  if (cpus == NULL) {
+    perror("Error fetching cpu frequency... " FREQUENCY_CPU_PATH " cannot be opened");
+    return false;
+  }
+
+  int cpuCapacity = 0;
+  int socketCapacity = 0;
+  struct dirent *entry;
+
+  while ((entry = readdir(cpus)) != NULL) {
+
+    // cpu0, cpu1, ... next to cpufreq, cpuidle, etc.
+    if (!isNumbered(entry -> d_name, "cpu") || strlen(entry -> d_name) >= FREQUENCY_NAME_LEN) {
+      continue;
+    }
+
+    if (!addFrequencyCPU(frequency, dirfd(cpus), entry -> d_name, &cpuCapacity)) {
+      continue;
+    }
+
+    FrequencyCPU *cpu = &(frequency -> cpus[frequency -> cpuCount - 1]);
+    FrequencySocket *socket = findSocket(frequency, cpu -> package, &socketCapacity);
+
+    // every cpu in a package has the same package count, so one is enough
+    if (socket != NULL && socket -> throttleFd == -1) {
+      socket -> throttleFd = openSysfs(frequency, dirfd(cpus), cpu -> name, FREQUENCY_PACKAGE_THROTTLE);
+      memcpy(socket -> name, cpu -> name, FREQUENCY_NAME_LEN);
+    }
+
+  }
+
+  closedir(cpus);
+
+  DIR *zones = opendir(FREQUENCY_THERMAL_PATH);
+
+  // no thermal zones at all is normal in a vm
+  if (zones == NULL) {
+    return true;
+  }
+
+  int zoneCapacity = 0;
+
+  while ((entry = readdir(zones)) != NULL) {
+    if (isNumbered(entry -> d_name, "thermal_zone") && strlen(entry -> d_name) < FREQUENCY_NAME_LEN) {
+      addThermalZone(frequency, dirfd(zones), entry -> d_name, &zoneCapacity);
+    }
+  }
+
+  closedir(zones);
+
+  return true;
+
+}
+
+void freeFrequency(Frequency *frequency) {
+
+  releaseSysfs(frequency);
+
+  free(frequency -> cpus);
+  free(frequency -> sockets);
+  free(frequency -> zones);
+
+  memset(frequency, 0, sizeof(Frequency));
+
+}
+
+void updateFrequency(Frequency *frequency) {
+
+  // throttle counts only mean something compared with the last pass
+  bool first = frequency -> pass == 0;
+
+  frequency -> pass++;
+
+  for (int i = 0; i < frequency -> socketCount; i++) {
+
+    FrequencySocket *socket = &(frequency -> sockets[i]);
+
+    socket -> cpus = 0;
+    socket -> min = INFINITY;
+    socket -> max = 0.0;
+    socket -> sum = 0.0;
+    socket -> throttled = 0;
+    socket -> packageThrottled = 0;
+
+    long long throttles;
+
+    if (socket -> throttleFd != -1 && readSysfsValue(socket -> throttleFd, FREQUENCY_CPU_PATH, socket -> name, FREQUENCY_PACKAGE_THROTTLE, &throttles)) {
+
+      if (!first && (unsigned long long) throttles > socket -> throttles) {
+        socket -> packageThrottled = throttles - socket -> throttles;
+      }
+
+      socket -> throttles = throttles;
+
+    }
+
+  }
+
+  for (int i = 0; i < frequency -> cpuCount; i++) {
+
+    FrequencyCPU *cpu = &(frequency -> cpus[i]);
+    FrequencySocket *socket = NULL;
+
+    // there are only ever a few sockets
+    for (int j = 0; j < frequency -> socketCount; j++) {
+      if (frequency -> sockets[j].package == cpu -> package) {
+        socket = &(frequency -> sockets[j]);
+        break;
+      }
+    }
+
+    if (socket == NULL) {
+      continue;
+    }
+
+    long long value;
+
+    // fails while the cpu is offline, so it is just left out until it comes back
+    if (cpu -> frequencyFd != -1 && readSysfsValue(cpu -> frequencyFd, FREQUENCY_CPU_PATH, cpu -> name, FREQUENCY_CUR_FREQ, &value)) {
+
+      double mhz = value / 1000.0;
+
+      socket -> cpus++;
+      socket -> min = fmin(socket -> min, mhz);
+      socket -> max = fmax(socket -> max, mhz);
+      socket -> sum += mhz;
+
+    }
+
+    if (cpu -> throttleFd != -1 && readSysfsValue(cpu -> throttleFd, FREQUENCY_CPU_PATH, cpu -> name, FREQUENCY_CORE_THROTTLE, &value)) {
+
+      if (!first && (unsigned long long) value > cpu -> throttles) {
+        socket -> throttled++;
+      }
+
+      cpu -> throttles = value;
+
+    }
+
+  }
+
+  for (int i = 0; i < frequency -> zoneCount; i++) {
+
+    ThermalZone *zone = &(frequency -> zones[i]);
+
+    long long value;
+
+    // some sensors fail reads while they are powered down
+    if (readSysfsValue(zone -> temperatureFd, FREQUENCY_THERMAL_PATH, zone -> name, "temp", &value)) {
+      zone -> temperature = value / 1000.0;
+    } else {
+      zone -> temperature = NAN;
+    }
+
+  }
+
+}
+
+bool addFrequencyCPU(Frequency *frequency, int cpusFd, const char *name, int *capacity) {
+
+  FrequencyCPU cpu = {
+    .package = 0,
+    .frequencyFd = openSysfs(frequency, cpusFd, name, FREQUENCY_CUR_FREQ),
+    .throttleFd = openSysfs(frequency, cpusFd, name, FREQUENCY_CORE_THROTTLE),
+    .throttles = 0
+  };
+
+  snprintf(cpu.name, sizeof(cpu.name), "%s", name);
+
+  // nothing to read for this cpu
+  if (cpu.frequencyFd == -1 && cpu.throttleFd == -1) {
+    return false;
+  }
+
+  // the package never changes, so it is read once and closed. it is -1 on some arm boards
+  int packageFd = openSysfs(frequency, cpusFd, name, FREQUENCY_PACKAGE_ID);
+  long long package;
+
+  if (packageFd != -1) {
+
+    if (readSysfsValue(packageFd, FREQUENCY_CPU_PATH, name, FREQUENCY_PACKAGE_ID, &package) && package >= 0) {
+      cpu.package = package;
+    }
+
+    closeSysfs(packageFd);
+
+  }
+
+  // any of the opens after the first may have been the one to run out, and this cpu isn't in the
+  // array yet, so it wasn't closed with the rest
+  cpu.frequencyFd = keepSysfs(frequency, cpu.frequencyFd);
+  cpu.throttleFd = keepSysfs(frequency, cpu.throttleFd);
+
+  if (frequency -> cpuCount == *capacity) {
+
+    int grown = *capacity > 0 ? *capacity * 2 : 64;
+    FrequencyCPU *cpus = realloc(frequency -> cpus, grown * sizeof(FrequencyCPU));
+
+    if (cpus == NULL) {
+
+      perror("Error fetching cpu frequency... realloc");
+      closeSysfs(cpu.frequencyFd);
+      closeSysfs(cpu.throttleFd);
+      return false;
+
+    }
+
+    frequency -> cpus = cpus;
+    *capacity = grown;
+
+  }
+
+  frequency -> cpus[frequency -> cpuCount++] = cpu;
+
+  return true;
+
+}
+
+// the socket for a package, added in order of package id if it is new
+FrequencySocket *findSocket(Frequency *frequency, int package, int *capacity) {
+
+  int i = 0;
+
+  while (i < frequency -> socketCount && frequency -> sockets[i].package < package) {
+    i++;
+  }
+
+  if (i < frequency -> socketCount && frequency -> sockets[i].package == package) {
+    return &(frequency -> sockets[i]);
+  }
+
+  if (frequency -> socketCount == *capacity) {
+
+    int grown = *capacity > 0 ? *capacity * 2 : 4;
+    FrequencySocket *sockets = realloc(frequency -> sockets, grown * sizeof(FrequencySocket));
+
+    if (sockets == NULL) {
+      perror("Error fetching cpu frequency... realloc");
+      return NULL;
+    }
+
+    frequency -> sockets = sockets;
+    *capacity = grown;
+
+  }
+
+  memmove(&(frequency -> sockets[i + 1]), &(frequency -> sockets[i]), (frequency -> socketCount - i) * sizeof(FrequencySocket));
+  frequency -> socketCount++;
+
+  FrequencySocket *socket = &(frequency -> sockets[i]);
+
+  memset(socket, 0, sizeof(FrequencySocket));
+  socket -> package = package;
+  socket -> throttleFd = -1;
+
+  return socket;
+
+}
+
+bool addThermalZone(Frequency *frequency, int zonesFd, const char *name, int *capacity) {
+
+  ThermalZone zone = {
+    .temperatureFd = openSysfs(frequency, zonesFd, name, "temp"),
+    .type = "",
+    .temperature = NAN
+  };
+
+  if (zone.temperatureFd == -1) {
+    return false;
+  }
+
+  snprintf(zone.name, sizeof(zone.name), "%s", name);
+
+  // the type never changes, so it is read once and closed
+  int typeFd = openSysfs(frequency, zonesFd, name, "type");
+
+  // opening the type may have been what ran out
+  zone.temperatureFd = keepSysfs(frequency, zone.temperatureFd);
+
+  if (typeFd == -1 || !readSysfs(typeFd, FREQUENCY_THERMAL_PATH, name, "type", zone.type, sizeof(zone.type))) {
+    snprintf(zone.type, sizeof(zone.type), "%s", name);
+  }
+
+  closeSysfs(typeFd);
+
+  zone.cpu = isCPUZone(zone.type);
+
+  if (frequency -> zoneCount == *capacity) {
+
+    int grown = *capacity > 0 ? *capacity * 2 : 8;
+    ThermalZone *zones = realloc(frequency -> zones, grown * sizeof(ThermalZone));
+
+    if (zones == NULL) {
+      perror("Error fetching thermal zones... realloc");
+      closeSysfs(zone.temperatureFd);
+      return false;
+    }
+
+    frequency -> zones = zones;
+    *capacity = grown;
+
+  }
+
+  frequency -> zones[frequency -> zoneCount++] = zone;
+
+  return true;
+
+}
+
+// intel's package sensor and coretemp, amd's k10temp, and cpu-thermal and the like on arm
+bool isCPUZone(const char *type) {
+  return strcmp(type, "x86_pkg_temp") == 0 || strcmp(type, "coretemp") == 0 || strcmp(type, "k10temp") == 0 ||
+         strncmp(type, "cpu", 3) == 0;
+}
+
+// opens <name>/<file> under a directory we have open, -1 if it doesn't exist, or FREQUENCY_CLOSED
+// if it does but we aren't keeping files open
+int openSysfs(Frequency *frequency, int dirFd, const char *name, const char *file) {
+
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", name, file);
+
+  if (!frequency -> reopen) {
+
+    int fd = openat(dirFd, path, O_RDONLY | O_CLOEXEC);
+
+    if (fd != -1 && fd < frequency -> fdLimit) {
+      return fd;
+    }
+
+    // every other file the process opens would fail next, so stop keeping any of them
+    if (fd != -1 || errno == EMFILE || errno == ENFILE) {
+      closeSysfs(fd);
+      releaseSysfs(frequency);
+    } else {
+      return -1;
+    }
+
+  }
+
+  return faccessat(dirFd, path, R_OK, 0) == 0 ? FREQUENCY_CLOSED : -1;
+
+}
+
+// an fd opened before files stopped being kept, closed if they have been since
+int keepSysfs(Frequency *frequency, int fd) {
+
+  if (frequency -> reopen && fd >= 0) {
+    close(fd);
+    return FREQUENCY_CLOSED;
+  }
+
+  return fd;
+
+}
+
+// closes every file we kept, from now on each read opens its file again
+void releaseSysfs(Frequency *frequency) {
+
+  frequency -> reopen = true;
+
+  for (int i = 0; i < frequency -> cpuCount; i++) {
+    frequency -> cpus[i].frequencyFd = keepSysfs(frequency, frequency -> cpus[i].frequencyFd);
+    frequency -> cpus[i].throttleFd = keepSysfs(frequency, frequency -> cpus[i].throttleFd);
+  }
+
+  for (int i = 0; i < frequency -> socketCount; i++) {
+    frequency -> sockets[i].throttleFd = keepSysfs(frequency, frequency -> sockets[i].throttleFd);
+  }
+
+  for (int i = 0; i < frequency -> zoneCount; i++) {
+    frequency -> zones[i].temperatureFd = keepSysfs(frequency, frequency -> zones[i].temperatureFd);
+  }
+
+}
+
+void closeSysfs(int fd) {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+// sysfs files are read from the start every time, and give a fresh value each time they are. a file
+// that isn't kept is opened again from <directory>/<name>/<file> just for this read
+bool readSysfs(int fd, const char *directory, const char *name, const char *file, char *value, int capacity) {
+
+  bool reopened = fd == FREQUENCY_CLOSED;
+
+  if (reopened) {
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s/%s", directory, name, file);
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  }
+
+  if (fd < 0) {
+    return false;
+  }
+
+  int length = pread(fd, value, capacity - 1, 0);
+
+  if (reopened) {
+    close(fd);
+  }
+
+  if (length <= 0) {
+    return false;
+  }
+
+  // they all end in a newline
+  while (length > 0 && (value[length - 1] == '\n' || value[length - 1] == ' ')) {
+    length--;
+  }
+
+  value[length] = '\0';
+
+  return length > 0;
+
+}
+
+bool readSysfsValue(int fd, const char *directory, const char *name, const char *file, long long *value) {
+
+  char string[FREQUENCY_VALUE_LEN];
+
+  if (!readSysfs(fd, directory, name, file, string, sizeof(string))) {
+    return false;
+  }
+
+  char *end;
+  *value = strtoll(string, &end, 10);
+
+  return end != string;
+
+}
+
+// whether name is prefix followed by only digits, ie. cpu12 but not cpufreq
+bool isNumbered(const char *name, const char *prefix) {
+
+  int length = strlen(prefix);
+
+  if (strncmp(name, prefix, length) != 0 || name[length] == '\0') {
+    return false;
+  }
+
+  for (const char *digit = name + length; *digit != '\0'; digit++) {
+    if (*digit < '0' || *digit > '9') {
+      return false;
+    }
+  }
+
+  return true;
+
+}
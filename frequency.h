@@ -0,0 +1,59 @@
+#include <stdbool.h>
+
+#define FREQUENCY_CPU_PATH "/sys/devices/system/cpu"
+#define FREQUENCY_THERMAL_PATH "/sys/class/thermal"
+
+#define FREQUENCY_TYPE_LEN 32
+#define FREQUENCY_NAME_LEN 32
+
+// a file that is there but opened again for every read, once we are short of fds
+#define FREQUENCY_CLOSED -2
+
+// fds left free for the rest of the process, files past this are opened for every read instead
+#define FREQUENCY_SPARE_FDS 64
+
+// the files of one cpu, opened once and read again with pread every pass. -1 if it doesn't have one
+typedef struct frequencyCPU {
+  char name[FREQUENCY_NAME_LEN]; // cpuN, to open its files again when they aren't kept
+  int package; // physical_package_id, the socket it is in
+  int frequencyFd; // cpufreq/scaling_cur_freq, kHz
+  int throttleFd; // thermal_throttle/core_throttle_count
+  unsigned long long throttles; // core_throttle_count as of the last pass
+} FrequencyCPU;
+
+typedef struct frequencySocket {
+  int package;
+  int throttleFd; // thermal_throttle/package_throttle_count of its first cpu
+  char name[FREQUENCY_NAME_LEN]; // the cpu it is read from
+  unsigned long long throttles;
+  int cpus; // cpus with a frequency this pass
+  double min; // MHz
+  double max;
+  double sum;
+  int throttled; // cpus whose core was throttled since the last pass
+  int packageThrottled; // times the package was throttled since the last pass
+} FrequencySocket;
+
+typedef struct thermalZone {
+  char name[FREQUENCY_NAME_LEN]; // thermal_zoneN
+  int temperatureFd; // temp, millidegrees C
+  char type[FREQUENCY_TYPE_LEN];
+  bool cpu; // one of the cpu's own sensors, not the battery, wifi card, or acpi zone
+  double temperature; // C, NAN if it couldn't be read this pass
+} ThermalZone;
+
+typedef struct frequency {
+  unsigned long pass;
+  bool reopen; // out of fds, so every file is opened for each read instead of kept
+  int fdLimit; // fds from here on aren't kept
+  FrequencyCPU *cpus;
+  int cpuCount;
+  FrequencySocket *sockets; // by package id
+  int socketCount;
+  ThermalZone *zones;
+  int zoneCount;
+} Frequency;
+
+bool initFrequency(Frequency *frequency);
+void freeFrequency(Frequency *frequency);
+void updateFrequency(Frequency *frequency);
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "graphics.h"
+
+#define DEFAULT_TERMINAL_WIDTH 80
+
+// unicode lower blocks from 1/8 to a full block, each is 3 bytes in utf-8
+#define SPARKLINE_LEVELS 8
+#define SPARKLINE_CHAR_LEN 3
+
+const char *SPARKLINE_CHARS[SPARKLINE_LEVELS] = {
+  "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"
+};
+
+// every render function below writes into line starting at index 0, never writes more than
+// capacity bytes including the \0, and returns how many characters it wrote so callers
+// can keep a cursor instead of calling strlen on the line again
+
+// asked for again every sample by updateTerminalWidth, so the graphics follow the terminal when it is resized
+int terminalWidth = 0;
+
+void updateTerminalWidth() {
+
+  struct winsize window;
+
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0) {
+    terminalWidth = window.ws_col;
+    return;
+  }
+
+  // not a terminal, ie. output is redirected to a file
+  char *columns = getenv("COLUMNS");
+
+  if (columns != NULL && strtol(columns, NULL, 10) > 0) {
+    terminalWidth = strtol(columns, NULL, 10);
+  } else {
+    terminalWidth = DEFAULT_TERMINAL_WIDTH;
+  }
+
+}
+
+int getTerminalWidth() {
+
+  // the collectors would otherwise ask every row
+  if (terminalWidth == 0) {
+    updateTerminalWidth();
+  }
+
+  return terminalWidth;
+
+}
+
+int getGraphicsWidth(int reserved, int maxWidth) {
+
+  // whatever is left of the terminal after the text on the same row
+  int width = getTerminalWidth() - reserved;
+
+  if (width > maxWidth) {
+    width = maxWidth;
+  }
+
+  if (width < 1) {
+    width = 1;
+  }
+
+  return width;
+
+}
+
+int renderRepeat(char *line, int capacity, char key, int count) {
+
+  if (capacity <= 0) {
+    return 0;
+  }
+
+  if (count > capacity - 1) {
+    count = capacity - 1;
+  }
+
+  if (count < 0) {
+    count = 0;
+  }
+
+  memset(line, key, count);
+  line[count] = '\0';
+
+  return count;
+
+}
+
+int renderStackedBar(char *line, int capacity, const double *values, const char *keys, int count, double scale) {
+
+  if (capacity <= 0) {
+    return 0;
+  }
+
+  int length = 0;
+  double cumulative = 0.0;
+
+  for (int i = 0; i < count; i++) {
+
+    // a key of \0 leaves that value out of the bar
+    if (keys[i] == '\0') {
+      continue;
+    }
+
+    // round the running total rather than each value, so many small values
+    // still add up to the same length as their sum
+    int start = (int) (cumulative / scale + 0.5);
+    cumulative += values[i];
+    int end = (int) (cumulative / scale + 0.5);
+
+    length += renderRepeat(line + length, capacity - length, keys[i], end - start);
+
+  }
+
+  line[length] = '\0';
+
+  return length;
+
+}
+
+int renderSparkline(char *line, int capacity, const double *values, int count, double min, double max) {
+
+  if (capacity <= 0) {
+    return 0;
+  }
+
+  // drop the oldest values if they don't all fit
+  int fit = (capacity - 1) / SPARKLINE_CHAR_LEN;
+
+  if (count > fit) {
+    values += count - fit;
+    count = fit;
+  }
+
+  double range = max - min;
+  int length = 0;
+
+  for (int i = 0; i < count; i++) {
+
+    int level = 0;
+
+    // a flat line is drawn at the lowest level
+    if (range > 0.0) {
+      level = (int) ((values[i] - min) / range * (SPARKLINE_LEVELS - 1) + 0.5);
+    }
+
+    if (level < 0) {
+      level = 0;
+    } else if (level > SPARKLINE_LEVELS - 1) {
+      level = SPARKLINE_LEVELS - 1;
+    }
+
+    memcpy(line + length, SPARKLINE_CHARS[level], SPARKLINE_CHAR_LEN);
+    length += SPARKLINE_CHAR_LEN;
+
+  }
+
+  line[length] = '\0';
+
+  return length;
+
+}
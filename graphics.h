@@ -0,0 +1,6 @@
+void updateTerminalWidth();
+int getTerminalWidth();
+int getGraphicsWidth(int reserved, int maxWidth);
+int renderRepeat(char *line, int capacity, char key, int count);
+int renderStackedBar(char *line, int capacity, const double *values, const char *keys, int count, double scale);
+int renderSparkline(char *line, int capacity, const double *values, int count, double min, double max);
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // pipe2, ppoll, sched_setaffinity
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -7,30 +8,58 @@
 #include <sys/wait.h>
 #include <sys/utsname.h>
 #include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
 #include "process_info.h"
+#include "frame.h"
 #include "stats_functions.h"
+#include "rules.h"
+
+// how late the kernel may wake us for a sample, so the wakeup can share a cpu's wakeup with others
+#define TIMER_SLACK_NS 1000000
+
+// past the highest nice level, so --nice=0 can still be asked for
+#define NICE_UNSET 20
 
-#define MAX_STRING_LEN 4096
 
 // argument handling
-int setFlags(int*, int, char**);
+int setFlags(int*, int, char**, char**, char**, char**, char**);
+bool parseCPUList(char *list, cpu_set_t *cpus);
 
 // signals
-void handleSignals(struct sigaction*, struct sigaction*);
-void setChildrenSignalHandler(struct sigaction* sigint);
+sigset_t handleSignals(struct sigaction*);
 void tstpHandler();
-void intHandler();
+bool handleSignal(int signalFd, int *flags, RuleSet *ruleSet, ProcessInfo *processes, bool *confirming, int samplesTaken, int delay, struct timespec *start);
+void askToExit();
+bool readExitAnswer();
+void reloadRules(RuleSet *ruleSet);
+void displayStats(int *flags, RuleSet *ruleSet, ProcessInfo *processes, int samplesTaken, int delay, struct timespec *start);
 
 // handling processes
-void handleProcesses(int*); 
-ProcessInfo initProcess(ProcessInfo*, void (*func)(int*, int[2]), int* flags, 
-                        ProcessType, struct sigaction* sigint);
-void addProcessToArray(ProcessInfo*, int, void (*func)(int*, int[2]), 
-                       int* flags, ProcessType, struct sigaction* sigint);
+void handleProcesses(int*, RuleSet*, int, cpu_set_t*);
+void placeProcess(int *flags, cpu_set_t *cpus);
+void recordSample(int recordFd, Frame *frame, char *host, struct timespec *timestamp, double *metrics);
+ProcessInfo initProcess(ProcessInfo*, void (*func)(int*, int[2], int), int* flags, 
+                        ProcessType);
+void addProcessToArray(ProcessInfo*, int, void (*func)(int*, int[2], int), 
+                       int* flags, ProcessType);
+
+// scheduling samples
+int clampDelay(int *flags, int delay);
+int getAdaptiveDelay(int *flags, int delay, double *metrics, double *lastMetrics);
+void addMilliseconds(struct timespec *time, int milliseconds);
+double getSecondsBetween(struct timespec *start, struct timespec *end);
 
 // extra stuff in main
-void displayHeaderInfo(int samples, int sampleNumber, int timeDelay);
-void displaySystemInformation();
+void displayHeaderInfo(int *flags, int sampleNumber, int delay, struct timespec *timestamp, double elapsed);
+void displaySystemInformation(Frame *frame);
 
 // screen
 void refreshScreen();
@@ -38,50 +67,88 @@ void refreshScreen();
 // help/error messages
 void printHelpPage(char*);
 void printErrorMessage(int, char*);
+int getFlagValue(char *flag);
 
 int main(int argc, char *argv[]) {
   
-   int flags[6] = {
+   int flags[14] = {
     0, //user
     0, //system
     0, //graphics
     0, //sequential
     10, //samples
     1, //tdelay seconds
+    0, //adaptive
+    250, //min delay milliseconds, adaptive only
+    5000, //max delay milliseconds, adaptive only
+    5, //cpu threshold percent, adaptive only
+    50, //memory threshold MB, adaptive only
+    0, //daemon
+    0, //sched, 0 leaves it as is, 1 is batch, 2 is idle
+    NICE_UNSET, //nice, NICE_UNSET leaves it as is
   };
 
-  if(setFlags(flags, argc, argv) == 0) {
+  char *rulesPath = NULL;
+  char *recordPath = NULL;
+  char *cpusList = NULL;
+  char *historyPrefix = NULL;
+
+  if(setFlags(flags, argc, argv, &rulesPath, &recordPath, &cpusList, &historyPrefix) == 0) {
     return 0;
   }
 
-  handleProcesses(flags);
+  // the processes write their histories when they exit
+  setHistoryExport(historyPrefix);
 
-  return 0;
+  cpu_set_t cpus;
 
-}
+  if (cpusList != NULL && !parseCPUList(cpusList, &cpus)) {
+    printErrorMessage(9, argv[0]);
+    return 0;
+  }
 
-void tstpHandler() {
-  // do nothing
-}
+  RuleSet ruleSet = {
+    .count = 0
+  };
 
-void intHandler() {
+  // compile the rules once, before any samples
+  if (rulesPath != NULL && !loadRules(&ruleSet, rulesPath)) {
+    return 0;
+  }
 
-  printf("Would you like to exit? yes (y) / no (any key): ");
+  int recordFd = -1;
 
-  char answer;
-  scanf(" %c", &answer);
+  // appended to so a restarted daemon keeps its history
+  if (recordPath != NULL) {
 
-  if (answer == 'y' || answer == 'Y') {
-    exit(0);
-  } 
+    recordFd = open(recordPath, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+
+    if (recordFd == -1) {
+      perror("Error opening recording... open");
+      freeRules(&ruleSet);
+      return 0;
+    }
+
+  }
+
+  handleProcesses(flags, &ruleSet, recordFd, cpusList != NULL ? &cpus : NULL);
+
+  if (recordFd != -1) {
+    close(recordFd);
+  }
+
+  stopHooks(&ruleSet);
+  freeRules(&ruleSet);
+
+  return 0;
 
 }
 
-void intHandlerChild() {
+void tstpHandler() {
   // do nothing
 }
 
-void handleSignals(struct sigaction* tstp, struct sigaction* sigint) {
+sigset_t handleSignals(struct sigaction* tstp) {
 
   tstp -> sa_handler = tstpHandler;
   sigfillset(&(tstp -> sa_mask)); // block signals
@@ -91,33 +158,169 @@ void handleSignals(struct sigaction* tstp, struct sigaction* sigint) {
     perror("SIGTSTP in handleSignals");
   }
 
-  sigint -> sa_handler = intHandler;
-  sigfillset(&(sigint -> sa_mask));
-  sigint -> sa_flags = 0;
+  // a rule writing to a fifo with no reader should get EPIPE, not kill us
+  signal(SIGPIPE, SIG_IGN);
+
+  // these are never delivered to a handler. the parent reads them from a signalfd between samples,
+  // and the children inherit them blocked, so they only ever stop when the parent closes their tick pipe
+  sigset_t signals;
+
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  sigaddset(&signals, SIGUSR1);
+
+  if (sigprocmask(SIG_BLOCK, &signals, NULL) == -1) {
+    perror("sigprocmask in handleSignals");
+  }
+
+  return signals;
+
+}
+
+bool handleSignal(int signalFd, int *flags, RuleSet *ruleSet, ProcessInfo *processes, bool *confirming, int samplesTaken, int delay, struct timespec *start) {
+
+  struct signalfd_siginfo info;
+
+  if (read(signalFd, &info, sizeof(info)) != sizeof(info)) {
+    return true;
+  }
+
+  int daemon = flags[11];
+
+  // the answer is read from stdin between samples, so sampling goes on while we wait for it.
+  // a second ctrl-c while asking is taken as a yes
+  if (info.ssi_signo == SIGINT && daemon == 0 && !*confirming) {
+    *confirming = true;
+    askToExit();
+  } else if (info.ssi_signo == SIGINT || info.ssi_signo == SIGTERM) {
+    printf("Received %s, stopping after %d samples...\n", strsignal(info.ssi_signo), samplesTaken);
+    return false;
+  } else if (info.ssi_signo == SIGHUP) {
+    reloadRules(ruleSet);
+  } else if (info.ssi_signo == SIGUSR1) {
+    displayStats(flags, ruleSet, processes, samplesTaken, delay, start);
+  }
+
+  return true;
+
+}
+
+void askToExit() {
+  printf("Would you like to exit? yes (y) / no (any key): ");
+  fflush(stdout);
+}
+
+// only called once stdin has something, so it never holds up sampling
+bool readExitAnswer() {
+
+  char answer[256];
+  int length = read(STDIN_FILENO, answer, sizeof(answer) - 1);
 
-  if (sigaction(SIGINT, sigint, NULL) == -1) {
-    perror("SIGINT in handleSignals");
+  // stdin closed, nobody is there to answer
+  if (length <= 0) {
+    return true;
   }
 
+  answer[length] = '\0';
+
+  char *first = answer + strspn(answer, " \t");
+
+  return *first == 'y' || *first == 'Y';
+
 }
 
-void setChildrenSignalHandler(struct sigaction* sigint) {
- 
-  sigint -> sa_handler = intHandlerChild; // set handler to the new child handler
-  sigemptyset(&(sigint -> sa_mask));
+void reloadRules(RuleSet *ruleSet) {
 
-  if (sigaction(SIGINT, sigint, NULL) == -1) {
-    perror("SIGINT in setChildrenSignalHandler");
+  if (ruleSet -> path == NULL) {
+    printf("Received SIGHUP, but there is no rules file to reload\n");
+    return;
+  }
+
+  // only replace the rules once the new ones have loaded, so a bad edit doesn't lose them
+  RuleSet reloaded;
+
+  if (!loadRules(&reloaded, ruleSet -> path)) {
+    printf("Received SIGHUP, keeping the previous %d rules from %s\n", ruleSet -> count, ruleSet -> path);
+    return;
   }
 
+  replaceRules(ruleSet, &reloaded);
+
+  printf("Received SIGHUP, reloaded %d rules from %s\n", ruleSet -> count, ruleSet -> path);
+
 }
 
-ProcessInfo initProcess(ProcessInfo *processes, void (*func)(int*, int[2]), int* flags, 
-                        ProcessType type, struct sigaction* sigint) {
+void displayStats(int *flags, RuleSet *ruleSet, ProcessInfo *processes, int samplesTaken, int delay, struct timespec *start) {
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  int alerts = ruleSet -> retiredFireCount;
+
+  for (int i = 0; i < ruleSet -> count; i++) {
+    alerts += ruleSet -> rules[i].fireCount;
+  }
+
+  printf("----------Stats-----------------------\n");
+
+  printf("Running for: %.0f second(s)\n", getSecondsBetween(start, &now));
+  printf("Samples taken: %d\n", samplesTaken);
+  printf("Current delay: %d ms%s\n", delay, flags[6] == 1 ? " (adaptive)" : "");
+  printf("Rules: %d, alerts fired: %d\n", ruleSet -> count, alerts);
+  printf("Memory Usage: %d kB\n", getCurrentProcessUsage());
+
+  char *PROCESS_NAMES[] = {"memory", "user", "cpu"};
+
+  // how long after the tick each process read its values, which is what the sample's time is off by
+  printf("Sample skew (last / max):\n");
+
+  for (int i = 0; i < 3; i++) {
+
+    if (!processes[i].success) {
+      continue;
+    }
+
+    printf("  %s: %.3f / %.3f ms\n", PROCESS_NAMES[processes[i].processType], processes[i].skew, processes[i].maxSkew);
+
+  }
+
+  // every wakeup is a context switch, involuntary ones are us taking a cpu from something else
+
+  long voluntary;
+  long involuntary;
+
+  printf("Context switches (voluntary / involuntary):\n");
+
+  if (getContextSwitches(getpid(), &voluntary, &involuntary)) {
+    printf("  parent %d: %ld / %ld\n", getpid(), voluntary, involuntary);
+  }
+
+  for (int i = 0; i < 3; i++) {
+
+    if (!processes[i].success || !getContextSwitches(processes[i].pid, &voluntary, &involuntary)) {
+      continue;
+    }
+
+    printf("  %s %d: %ld / %ld\n", PROCESS_NAMES[processes[i].processType], processes[i].pid, voluntary, involuntary);
+
+  }
+
+  printf("--------------------------------------\n");
+
+  fflush(stdout);
+
+}
+
+ProcessInfo initProcess(ProcessInfo *processes, void (*func)(int*, int[2], int), int* flags, 
+                        ProcessType type) {
   
   int pipes[2];
+  int ticks[2];
 
-  if (pipe(pipes) == -1) {
+  // close on exec so hooks run by rules don't hold the pipes open
+  if (pipe2(pipes, O_CLOEXEC) == -1) {
     
     perror("Error creating pipe in initProcess");
 
@@ -129,12 +332,29 @@ ProcessInfo initProcess(ProcessInfo *processes, void (*func)(int*, int[2]), int*
 
   }
 
+  if (pipe2(ticks, O_CLOEXEC) == -1) {
+
+    close(pipes[0]);
+    close(pipes[1]);
+
+    perror("Error creating tick pipe in initProcess");
+
+    ProcessInfo processInfo = {
+      .success = false
+    };
+
+    return processInfo;
+
+  }
+
   pid_t pid = fork();
 
   if (pid == -1) {
 
     close(pipes[0]);
     close(pipes[1]);
+    close(ticks[0]);
+    close(ticks[1]);
 
     perror("Error forking in initProcess");
 
@@ -156,17 +376,18 @@ ProcessInfo initProcess(ProcessInfo *processes, void (*func)(int*, int[2]), int*
       }
 
       close(processes[i].pipeAccess[0]);
-      close(processes[i].pipeAccess[1]);
+      close(processes[i].tickAccess[1]);
 
     }
 
-    setChildrenSignalHandler(sigint); // set the signal handler for the children
-
     close(pipes[0]); // close read end for child, child doesn't need it
+    close(ticks[1]); // only the parent sends ticks
 
     // child
 
-    (*func)(flags, pipes);
+    (*func)(flags, pipes, ticks[0]);
+
+    close(ticks[0]);
 
     ProcessInfo processInfo = {
       .success = true,
@@ -180,11 +401,14 @@ ProcessInfo initProcess(ProcessInfo *processes, void (*func)(int*, int[2]), int*
   } 
 
   // is parent
+
+  close(ticks[0]); // the child reads ticks, the parent only writes them
   
   ProcessInfo processInfo = {
     .pid = pid,
     .processType = type,
     .pipeAccess = {pipes[0], pipes[1]},
+    .tickAccess = {ticks[0], ticks[1]},
     .success = true,
     .isChild = false
   };
@@ -193,10 +417,10 @@ ProcessInfo initProcess(ProcessInfo *processes, void (*func)(int*, int[2]), int*
 
 }
 
-void addProcessToArray(ProcessInfo *processes, int index, void (*func)(int*, int[2]), 
-                       int* flags, ProcessType type, struct sigaction* sigint) {
+void addProcessToArray(ProcessInfo *processes, int index, void (*func)(int*, int[2], int), 
+                       int* flags, ProcessType type) {
 
-  ProcessInfo processInfo = initProcess(processes, func, flags, type, sigint);
+  ProcessInfo processInfo = initProcess(processes, func, flags, type);
 
   if (!processInfo.success) {
     perror("Error making new user process in initProcess");
@@ -215,13 +439,15 @@ void addProcessToArray(ProcessInfo *processes, int index, void (*func)(int*, int
 
 }
 
-void handleProcesses(int* flags) {
+void handleProcesses(int* flags, RuleSet *ruleSet, int recordFd, cpu_set_t *cpus) {
 
   int user = flags[0];
   int system = flags[1];
   int sequential = flags[3];
   int samples = flags[4];
   int tdelay = flags[5];
+  int adaptive = flags[6];
+  int daemon = flags[11];
 
   // children[0] is memory process, children[1] is user process, children[2] is cpu process. -1 if we don't have a new process for that
   ProcessInfo invalid = {
@@ -235,28 +461,99 @@ void handleProcesses(int* flags) {
   ProcessType cpuType = 2;
 
   struct sigaction tstp;
-  struct sigaction sigint;
 
-  handleSignals(&tstp, &sigint);
+  sigset_t signals = handleSignals(&tstp);
+
+  // before forking, so the children inherit it
+  placeProcess(flags, cpus);
 
   // init processes for memory, user, and cpu. using for loop to mitigate how often we repeat the code 
   if (user == 1) {
-    addProcessToArray(processes, 1, handleReportUsers, flags, userType, &sigint);
+    addProcessToArray(processes, 1, handleReportUsers, flags, userType);
   }
 
   if (system == 1) {
-    addProcessToArray(processes, 0, handleReportMemory, flags, memoryType, &sigint);
-    addProcessToArray(processes, 2, handleReportCPU, flags, cpuType, &sigint);
+    addProcessToArray(processes, 0, handleReportMemory, flags, memoryType);
+    addProcessToArray(processes, 2, handleReportCPU, flags, cpuType);
+  }
+
+  // created after forking so only the parent reads signals
+  int signalFd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+  if (signalFd == -1) {
+    perror("signalfd in handleProcesses");
   }
 
-  for (int i = 0; i < samples; i++) {
+  // every sample is read into the same frame, which grows to fit the biggest one
+  Frame frame;
+  initFrame(&frame);
+
+  // recordings from many hosts are told apart by this
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1);
+
+  // the delay until the next sample in milliseconds, only changes in adaptive mode
+  int delay = tdelay * 1000;
+
+  if (adaptive == 1) {
+    delay = clampDelay(flags, delay);
+  }
+
+  double lastMetrics[METRIC_COUNT];
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    lastMetrics[i] = NAN;
+  }
+
+  // samples are scheduled on absolute times so time spent printing doesn't add up
+  struct timespec nextTick;
+  clock_gettime(CLOCK_MONOTONIC, &nextTick);
+
+  struct timespec lastTick = nextTick;
+  struct timespec start = nextTick;
+
+  bool running = true;
+
+  // waiting for an answer to askToExit
+  bool confirming = false;
+
+  // 0 samples runs until we get a signal to stop
+  for (int i = 0; running && (samples == 0 || i < samples); i++) {
+
+    Tick tick = {
+      .sampleNumber = i + 1
+    };
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_REALTIME, &tick.timestamp);
+
+    double elapsed = getSecondsBetween(&lastTick, &now);
+    lastTick = now;
+
+    // wake up every process for this sample
+    for (int j = 0; j < 3; j++) {
+
+      if (!processes[j].success) {
+        continue;
+      }
+
+      writeFull(processes[j].tickAccess[1], &tick, sizeof(Tick));
 
-    if (sequential == 0) {
+    }
+
+    if (sequential == 0 && daemon == 0) {
       refreshScreen();
     }
 
     bool printedHeader = false;
 
+    double metrics[METRIC_COUNT];
+
+    for (int j = 0; j < METRIC_COUNT; j++) {
+      metrics[j] = NAN;
+    }
+
     for (int j = 0; j < 3; j++) {
 
       // make sure it is a valid process 
@@ -266,33 +563,137 @@ void handleProcesses(int* flags) {
 
       // we loop from memory -> user -> cpu to ensure correct order
     
-      char buffer[MAX_STRING_LEN];
+      SampleHeader header;
 
-      if (read(processes[j].pipeAccess[0], buffer, MAX_STRING_LEN) > 0) {
+      if (readSample(processes[j].pipeAccess[0], &header, &frame)) {
 
         // we do this so that formatting is correct
         if (!printedHeader) {
-          displayHeaderInfo(samples, i + 1, tdelay);
+          displayHeaderInfo(flags, i + 1, delay, &tick.timestamp, elapsed);
           printedHeader = true;
         }
 
-        printf("%s", buffer);
+        fwrite(frame.data, 1, frame.length, stdout);
 
         // append system info after cpu info 
         if (processes[j].processType == cpuType) {
-          displaySystemInformation();
+          displaySystemInformation(&frame);
+        }
+
+        // the tick and the header are both CLOCK_REALTIME
+        processes[j].skew = getSecondsBetween(&tick.timestamp, &header.timestamp) * 1000.0;
+        processes[j].maxSkew = fmax(processes[j].maxSkew, processes[j].skew);
+
+        // each process only reports its own metrics, the rest are NAN
+        for (int k = 0; k < METRIC_COUNT; k++) {
+          if (!isnan(header.metrics[k])) {
+            metrics[k] = header.metrics[k];
+          }
         }
 
       }
 
     } 
 
+    if (recordFd != -1) {
+      recordSample(recordFd, &frame, host, &tick.timestamp, metrics);
+    }
+
+    evaluateRules(ruleSet, metrics, &now);
+
+    // the sample may have cleared the screen, so ask again under it
+    if (confirming) {
+      askToExit();
+    }
+
+    fflush(stdout);
+
+    if (i == samples - 1) {
+      break;
+    }
+
+    if (adaptive == 1) {
+      delay = getAdaptiveDelay(flags, delay, metrics, lastMetrics);
+    }
+
+    memcpy(lastMetrics, metrics, sizeof(metrics));
+
+    addMilliseconds(&nextTick, delay);
+
+    // if we fell behind, start counting from now instead of rushing to catch up
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (getSecondsBetween(&now, &nextTick) < 0) {
+      nextTick = now;
+    }
+
+    // wait for the next sample, handling signals as they come in so they never hold up sampling
+    while (running && getSecondsBetween(&now, &nextTick) > 0) {
+
+      double wait = getSecondsBetween(&now, &nextTick);
+
+      struct timespec timeout = {
+        .tv_sec = (time_t) wait,
+        .tv_nsec = (long) ((wait - (time_t) wait) * 1000000000.0)
+      };
+
+      // stdin is only watched while we are waiting for an answer, poll skips negative fds
+      struct pollfd polls[2] = {
+        {
+          .fd = signalFd,
+          .events = POLLIN
+        },
+        {
+          .fd = confirming ? STDIN_FILENO : -1,
+          .events = POLLIN
+        }
+      };
+
+      if (ppoll(polls, 2, &timeout, NULL) > 0) {
+
+        if (polls[0].revents & POLLIN) {
+          running = handleSignal(signalFd, flags, ruleSet, processes, &confirming, i + 1, delay, &start);
+        }
+
+        if (running && confirming && polls[1].revents != 0) {
+          running = !readExitAnswer();
+          confirming = false;
+        }
+
+        fflush(stdout);
+
+      }
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+
+    }
+
+  }
+
+  close(signalFd);
+  freeFrame(&frame);
+
+  // closing the tick pipes tells the children there are no more samples
+  for (int i = 0; i < 3; i++) {
+
+    if (!processes[i].success) {
+      continue;
+    }
+
+    close(processes[i].tickAccess[1]);
+
   }
 
-  int status = 0;
+  // wait for the children to finish, by pid so hooks from rules are left to stopHooks
+  for (int i = 0; i < 3; i++) {
+
+    if (!processes[i].success) {
+      continue;
+    }
+
+    waitpid(processes[i].pid, NULL, 0);
 
-  // wait for children to finish
-  while (wait(&status) > 0); 
+  }
 
   // close all pipe read fds
   for (int i = 0; i < 3; i++) {
@@ -307,36 +708,212 @@ void handleProcesses(int* flags) {
 
 }
 
-void displaySystemInformation() {
+// keeps us out of the way of the work the machine is for, the children get all of this when they fork
+void placeProcess(int *flags, cpu_set_t *cpus) {
+
+  int sched = flags[12];
+  int nice = flags[13];
+
+  if (cpus != NULL && sched_setaffinity(0, sizeof(cpu_set_t), cpus) == -1) {
+    perror("Error setting cpus... sched_setaffinity");
+  }
+
+  // neither preempts anything when it wakes up, so the children woken for a sample run one after
+  // another instead of each taking the cpu from the parent, and idle only runs when nothing else will
+  if (sched != 0) {
+
+    struct sched_param param = {
+      .sched_priority = 0
+    };
+
+    if (sched_setscheduler(0, sched == 1 ? SCHED_BATCH : SCHED_IDLE, &param) == -1) {
+      perror("Error setting scheduling policy... sched_setscheduler");
+    }
+
+    // ppoll's timeout honours this, the tick timer is the only one we have
+    if (prctl(PR_SET_TIMERSLACK, TIMER_SLACK_NS, 0, 0, 0) == -1) {
+      perror("Error setting timer slack... prctl");
+    }
+
+  }
+
+  if (nice != NICE_UNSET && setpriority(PRIO_PROCESS, 0, nice) == -1) {
+    perror("Error setting nice level... setpriority");
+  }
+
+}
+
+// one line of json per sample, ie. {"host":"build1","time":1760781600000,"memory_used":0.9512,...}
+void recordSample(int recordFd, Frame *frame, char *host, struct timespec *timestamp, double *metrics) {
+
+  resetFrame(frame);
+
+  appendString(frame, "{\"host\":\"");
+
+  // hostnames shouldn't have these, but the line has to stay valid json
+  for (char *character = host; *character != '\0'; character++) {
+
+    if (*character == '"' || *character == '\\') {
+      appendChar(frame, '\\');
+    }
+
+    appendChar(frame, *character);
+
+  }
+
+  appendString(frame, "\",\"time\":");
+  appendInt(frame, (long long) timestamp -> tv_sec * 1000 + timestamp -> tv_nsec / 1000000);
+
+  // metrics nobody reported this sample are left out
+  for (int i = 0; i < METRIC_COUNT; i++) {
+
+    if (isnan(metrics[i])) {
+      continue;
+    }
+
+    appendString(frame, ",\"");
+    appendString(frame, getMetricName(i));
+    appendString(frame, "\":");
+    appendDouble(frame, metrics[i], 4);
+
+  }
+
+  appendString(frame, "}\n");
+
+  // a single write, so a line is never split with another writer appending to the same file
+  if (write(recordFd, frame -> data, frame -> length) == -1) {
+    perror("Error recording sample... write");
+  }
+
+}
+
+int clampDelay(int *flags, int delay) {
+
+  int minDelay = flags[7];
+  int maxDelay = flags[8];
+
+  if (delay < minDelay) {
+    return minDelay;
+  }
+
+  if (delay > maxDelay) {
+    return maxDelay;
+  }
+
+  return delay;
+
+}
+
+int getAdaptiveDelay(int *flags, int delay, double *metrics, double *lastMetrics) {
+
+  int cpuThreshold = flags[9];
+  int memoryThreshold = flags[10];
+
+  // comparisons with NAN are false, so metrics missing from either sample never count as a change
+  bool changed = fabs(metrics[METRIC_CPU_USAGE] - lastMetrics[METRIC_CPU_USAGE]) >= cpuThreshold
+              || fabs(metrics[METRIC_MEMORY_USED] - lastMetrics[METRIC_MEMORY_USED]) * 1000.0 >= memoryThreshold
+              || fabs(metrics[METRIC_USERS] - lastMetrics[METRIC_USERS]) >= 1.0;
+
+  // jump straight to the fastest rate so we catch the rest of a burst, otherwise back off gradually
+  if (changed) {
+    return flags[7];
+  }
+
+  int maxDelay = flags[8];
+
+  // at least 1 ms, or a delay of 1 ms would never grow
+  int step = delay / 2 > 0 ? delay / 2 : 1;
+
+  // checked before adding, so a huge --max-delay can't overflow
+  if (delay >= maxDelay - step) {
+    return maxDelay;
+  }
+
+  return clampDelay(flags, delay + step);
+
+}
+
+void addMilliseconds(struct timespec *time, int milliseconds) {
+
+  time -> tv_sec += milliseconds / 1000;
+  time -> tv_nsec += (long) (milliseconds % 1000) * 1000000L;
+
+  if (time -> tv_nsec >= 1000000000L) {
+    time -> tv_sec++;
+    time -> tv_nsec -= 1000000000L;
+  }
+
+}
+
+double getSecondsBetween(struct timespec *start, struct timespec *end) {
+  return (double) (end -> tv_sec - start -> tv_sec) + (double) (end -> tv_nsec - start -> tv_nsec) / 1000000000.0;
+}
+
+void displaySystemInformation(Frame *frame) {
+
+  resetFrame(frame);
 
-  printf("----------System-Information----------\n");
+  appendString(frame, "----------System-Information----------\n");
 
   // create the buffer
   struct utsname systemInfo;
 
   if (uname(&systemInfo) == -1) {
-    printf("Error Fetching System Information... uname\n");
+    appendString(frame, "Error Fetching System Information... uname\n");
+    fwrite(frame -> data, 1, frame -> length, stdout);
     return;
   }
 
-  // multiple print statements for clarity
-  printf("System Name: %s\n", systemInfo.sysname);
-  printf("Machine Name: %s\n", systemInfo.nodename);
-  printf("OS Release: %s\n", systemInfo.release);
-  printf("OS Version: %s\n", systemInfo.version);
-  printf("Architecture: %s\n", systemInfo.machine);
+  // one line each for clarity
+  appendString(frame, "System Name: ");
+  appendString(frame, systemInfo.sysname);
+  appendString(frame, "\nMachine Name: ");
+  appendString(frame, systemInfo.nodename);
+  appendString(frame, "\nOS Release: ");
+  appendString(frame, systemInfo.release);
+  appendString(frame, "\nOS Version: ");
+  appendString(frame, systemInfo.version);
+  appendString(frame, "\nArchitecture: ");
+  appendString(frame, systemInfo.machine);
+  appendChar(frame, '\n');
 
+  appendString(frame, "--------------------------------------\n");
 
-  printf("--------------------------------------\n");
+  fwrite(frame -> data, 1, frame -> length, stdout);
 
 }
 
-void displayHeaderInfo(int samples, int sampleNumber, int timeDelay) {
+void displayHeaderInfo(int *flags, int sampleNumber, int delay, struct timespec *timestamp, double elapsed) {
+
+  int samples = flags[4];
+  int timeDelay = flags[5];
 
   printf("\n+-------------------------------------+\n\n");
 
-  printf("%d samples every %d second(s)\n", samples, timeDelay);
-  printf("Sample #%d\n\n", sampleNumber);
+  if (samples == 0) {
+    printf("Sampling until stopped ");
+  } else {
+    printf("%d samples ", samples);
+  }
+
+  if (flags[6] == 1) {
+    printf("every %d-%d ms (adaptive, currently %d ms)\n", flags[7], flags[8], delay);
+  } else {
+    printf("every %d second(s)\n", timeDelay);
+  }
+
+  // local time the sample was taken at, with milliseconds
+  char time[32];
+  struct tm localTime;
+
+  localtime_r(&(timestamp -> tv_sec), &localTime);
+  strftime(time, sizeof(time), "%H:%M:%S", &localTime);
+
+  if (sampleNumber == 1) {
+    printf("Sample #%d at %s.%03ld\n\n", sampleNumber, time, timestamp -> tv_nsec / 1000000);
+  } else {
+    printf("Sample #%d at %s.%03ld (%.3f s since last sample)\n\n", sampleNumber, time, timestamp -> tv_nsec / 1000000, elapsed);
+  }
 
   printf("Memory Usage: %d kB\n\n", getCurrentProcessUsage());
 
@@ -348,10 +925,13 @@ void refreshScreen() {
   printf("\033[2J"); // refresh screen
 }
 
-int setFlags(int *flags, int argc, char *argv[]) {
+int setFlags(int *flags, int argc, char *argv[], char **rulesPath, char **recordPath, char **cpusList, char **historyPrefix) {
   
   char *execName = argv[0];
 
+  bool samplesGiven = false;
+  bool maxDelayGiven = false;
+
   // parse command line arguments
   for (int i = 1; i < argc; i++) {
 
@@ -389,6 +969,7 @@ int setFlags(int *flags, int argc, char *argv[]) {
       if (sampleSize > 0) {
       
         flags[4] = sampleSize;
+        samplesGiven = true;
       
       } else {
         printErrorMessage(1, execName);
@@ -417,6 +998,120 @@ int setFlags(int *flags, int argc, char *argv[]) {
         return 0;
       }
 
+    } else if (strcmp(flag, "--daemon") == 0) {
+      flags[11] = 1;
+    } else if (strcmp(flag, "--adaptive") == 0) {
+      flags[6] = 1;
+    } else if (strcmp(flag, "--min-delay") == 0) {
+
+      int minDelay = getFlagValue(flag);
+
+      if (minDelay <= 0) {
+        printErrorMessage(3, execName);
+        return 0;
+      }
+
+      flags[7] = minDelay;
+
+    } else if (strcmp(flag, "--max-delay") == 0) {
+
+      int maxDelay = getFlagValue(flag);
+
+      if (maxDelay <= 0) {
+        printErrorMessage(4, execName);
+        return 0;
+      }
+
+      flags[8] = maxDelay;
+      maxDelayGiven = true;
+
+    } else if (strcmp(flag, "--cpu-threshold") == 0) {
+
+      int cpuThreshold = getFlagValue(flag);
+
+      if (cpuThreshold <= 0) {
+        printErrorMessage(5, execName);
+        return 0;
+      }
+
+      flags[9] = cpuThreshold;
+
+    } else if (strcmp(flag, "--memory-threshold") == 0) {
+
+      int memoryThreshold = getFlagValue(flag);
+
+      if (memoryThreshold <= 0) {
+        printErrorMessage(6, execName);
+        return 0;
+      }
+
+      flags[10] = memoryThreshold;
+
+    } else if (strcmp(flag, "--rules") == 0) {
+
+      *rulesPath = strtok(NULL, "=");
+
+      if (*rulesPath == NULL) {
+        printErrorMessage(7, execName);
+        return 0;
+      }
+
+    } else if (strcmp(flag, "--record") == 0) {
+
+      *recordPath = strtok(NULL, "=");
+
+      if (*recordPath == NULL) {
+        printErrorMessage(8, execName);
+        return 0;
+      }
+
+    } else if (strcmp(flag, "--history") == 0) {
+
+      *historyPrefix = strtok(NULL, "=");
+
+      if (*historyPrefix == NULL) {
+        printErrorMessage(12, execName);
+        return 0;
+      }
+
+    } else if (strcmp(flag, "--cpus") == 0) {
+
+      // checked once it is parsed in main
+      *cpusList = strtok(NULL, "=");
+
+      if (*cpusList == NULL) {
+        printErrorMessage(9, execName);
+        return 0;
+      }
+
+    } else if (strcmp(flag, "--sched") == 0) {
+
+      flag = strtok(NULL, "=");
+
+      if (flag != NULL && strcmp(flag, "batch") == 0) {
+        flags[12] = 1;
+      } else if (flag != NULL && strcmp(flag, "idle") == 0) {
+        flags[12] = 2;
+      } else {
+        printErrorMessage(10, execName);
+        return 0;
+      }
+
+    } else if (strcmp(flag, "--nice") == 0) {
+
+      // getFlagValue can't tell -1 apart from no value
+      flag = strtok(NULL, "=");
+
+      char *end = NULL;
+      int nice = flag != NULL ? strtol(flag, &end, 10) : 0;
+
+      if (flag == NULL || *end != '\0' || nice < -20 || nice > 19) {
+        printErrorMessage(11, execName);
+        return 0;
+      }
+
+      flags[13] = nice;
+
     } else if (i == 1) {
 
       int samples = strtol(flag, NULL, 10);
@@ -424,6 +1119,7 @@ int setFlags(int *flags, int argc, char *argv[]) {
       if (samples > 0) {
 
         flags[4] = samples;
+        samplesGiven = true;
 
       } else {
         printErrorMessage(1, execName);
@@ -456,6 +1152,18 @@ int setFlags(int *flags, int argc, char *argv[]) {
     flags[1] = 1;
   }
 
+  // a daemon runs until it is stopped, unless it was asked for a number of samples
+  if (flags[11] == 1 && !samplesGiven) {
+    flags[4] = 0;
+  }
+
+  // the delays are only used by adaptive sampling, so they are only checked against each other for it
+  // and the error is about whichever one was given, the other is a default
+  if (flags[6] == 1 && flags[7] > flags[8]) {
+    printErrorMessage(maxDelayGiven ? 4 : 3, execName);
+    return 0;
+  }
+
   return 1;
 
 }
@@ -470,11 +1178,23 @@ void printHelpPage(char *execName) {
     "--graphics (include graphical output where possible)",
     "--sequential (information output sequentially, no refreshing of screen)",
     "--samples=N (take N samples over the specified time)",
-    "--tdelay=T (take N samples previously over T time in seconds)"
+    "--tdelay=T (take N samples previously over T time in seconds)",
+    "--adaptive (sample faster when usage changes and slower when it is stable, starting at T)",
+    "--min-delay=MS (shortest time between adaptive samples in milliseconds, default 250)",
+    "--max-delay=MS (longest time between adaptive samples in milliseconds, default 5000)",
+    "--cpu-threshold=P (change in cpu usage percent that speeds up adaptive sampling, default 5)",
+    "--memory-threshold=MB (change in memory used in MB that speeds up adaptive sampling, default 50)",
+    "--rules=FILE (check every sample against the alert rules in FILE)",
+    "--record=FILE (append every sample to FILE as a line of json, see sysinfo-analyze)",
+    "--daemon (run headless until SIGINT or SIGTERM, SIGHUP reloads rules and SIGUSR1 prints stats)",
+    "--history=PREFIX (write the memory and cpu history to PREFIX.memory.csv and PREFIX.cpu.csv on exit)",
+    "--cpus=LIST (only run on the cpus in LIST, ie. 0-1,6)",
+    "--sched=idle|batch (run under SCHED_IDLE or SCHED_BATCH so sampling never preempts other work)",
+    "--nice=N (run at nice level N, from -20 to 19, ignored under --sched=idle)"
   };
 
   // iterate through array and print each message
-  for (int i = 0; i < 7; i++) {
+  for (int i = 0; i < sizeof(HELP_COMMANDS) / sizeof(HELP_COMMANDS[0]); i++) {
     printf("%s %s\n", execName, HELP_COMMANDS[i]);
   }
 
@@ -487,9 +1207,81 @@ void printErrorMessage(int index, char *execName) {
     "Invalid command line arguments. Use '%s --help' to see a list of commands.\n",
     "Invalid command line arguments. Your flag '--samples=N' is invalid. N must be a positive integer. Use '%s --help' to see a list of commands.\n",
     "Invalid command line arguments. Your flag '--tdelay=T' is invalid. T must be a positive integer. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--min-delay=MS' is invalid. MS must be a positive integer, at most '--max-delay'. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--max-delay=MS' is invalid. MS must be a positive integer, at least '--min-delay'. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--cpu-threshold=P' is invalid. P must be a positive integer. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--memory-threshold=MB' is invalid. MB must be a positive integer. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--rules=FILE' is invalid. FILE must be a path. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--record=FILE' is invalid. FILE must be a path. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--cpus=LIST' is invalid. LIST must be cpu numbers and ranges separated by commas, ie. 0-1,6. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--sched=POLICY' is invalid. POLICY must be idle or batch. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--nice=N' is invalid. N must be an integer from -20 to 19. Use '%s --help' to see a list of commands.\n",
+    "Invalid command line arguments. Your flag '--history=PREFIX' is invalid. PREFIX must be a path. Use '%s --help' to see a list of commands.\n",
   };
 
   printf(ERROR_MESSAGES[index], execName);
 
 }
 
+// helper to get the value after the = of a flag, -1 if there isn't one
+int getFlagValue(char *flag) {
+
+  flag = strtok(NULL, "=");
+
+  if (flag == NULL) {
+    return -1;
+  }
+
+  return strtol(flag, NULL, 10);
+
+}
+
+// parses a list like 0-1,6 the way taskset and /sys do, false if it is malformed or has no cpus
+bool parseCPUList(char *list, cpu_set_t *cpus) {
+
+  CPU_ZERO(cpus);
+
+  char *cursor = list;
+
+  while (*cursor != '\0') {
+
+    char *end;
+    long first = strtol(cursor, &end, 10);
+    long last = first;
+
+    if (end == cursor || first < 0) {
+      return false;
+    }
+
+    if (*end == '-') {
+
+      cursor = end + 1;
+      last = strtol(cursor, &end, 10);
+
+      if (end == cursor || last < first) {
+        return false;
+      }
+
+    }
+
+    if (last >= CPU_SETSIZE) {
+      return false;
+    }
+
+    for (long cpu = first; cpu <= last; cpu++) {
+      CPU_SET(cpu, cpus);
+    }
+
+    if (*end == ',') {
+      end++;
+    } else if (*end != '\0') {
+      return false;
+    }
+
+    cursor = end;
+
+  }
+
+  return CPU_COUNT(cpus) > 0;
+
+}
@@ -1,14 +1,49 @@
 #include <sys/types.h>
 #include <stdbool.h>
+#include <time.h>
 
 typedef int ProcessType;
 
 typedef struct processInfo {
   pid_t pid;
-  int pipeAccess[2]; 
+  int pipeAccess[2];
+  int tickAccess[2]; // parent writes a Tick here every time it wants a sample
   ProcessType processType;
   bool success;
   bool isChild;
+  double skew; // ms from the last tick to when the process read its values
+  double maxSkew;
 } ProcessInfo;
 
+// numeric values a sample carries alongside its text, NAN if the process doesn't report it
+#define METRIC_MEMORY_USED 0 // GB
+#define METRIC_MEMORY_TOTAL 1 // GB
+#define METRIC_MEMORY_PERCENT 2
+#define METRIC_VIRTUAL_USED 3 // GB
+#define METRIC_VIRTUAL_TOTAL 4 // GB
+#define METRIC_CPU_USAGE 5
+#define METRIC_CPU_USER 6 // followed by the rest of the cpu breakdown, in /proc/stat order
+#define METRIC_CPU_NICE 7
+#define METRIC_CPU_SYSTEM 8
+#define METRIC_CPU_IDLE 9
+#define METRIC_CPU_IOWAIT 10
+#define METRIC_CPU_IRQ 11
+#define METRIC_CPU_SOFTIRQ 12
+#define METRIC_CPU_STEAL 13
+#define METRIC_CPU_GUEST 14
+#define METRIC_USERS 15
+#define METRIC_CPU_FREQUENCY 16 // MHz, average of every cpu
+#define METRIC_CPU_TEMPERATURE 17 // C, hottest thermal zone
+#define METRIC_CPU_THROTTLED 18 // cpus throttled since the last sample
+#define METRIC_COUNT 19
 
+typedef struct tick {
+  int sampleNumber; // starts at 1
+  struct timespec timestamp; // CLOCK_REALTIME when the parent asked for the sample
+} Tick;
+
+typedef struct sampleHeader {
+  struct timespec timestamp; // CLOCK_REALTIME when the process read its values
+  double metrics[METRIC_COUNT];
+  int length; // bytes of text following the header, without a \0
+} SampleHeader;
@@ -0,0 +1,508 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "process_info.h"
+#include "rules.h"
+
+#define RULE_LINE_LEN 1024
+
+const char *METRIC_NAMES[METRIC_COUNT] = {
+  "memory_used",
+  "memory_total",
+  "memory_percent",
+  "virtual_used",
+  "virtual_total",
+  "cpu_usage",
+  "cpu_user",
+  "cpu_nice",
+  "cpu_system",
+  "cpu_idle",
+  "cpu_iowait",
+  "cpu_irq",
+  "cpu_softirq",
+  "cpu_steal",
+  "cpu_guest",
+  "users",
+  "cpu_frequency",
+  "cpu_temperature",
+  "cpu_throttled"
+};
+
+const char *OPERATORS[] = {">", ">=", "<", "<=", "==", "!="};
+
+bool parseRule(Rule *rule, char *line, int lineNumber);
+double parseDuration(char *string);
+bool isRuleTrue(Rule *rule, double value);
+void fireRule(RuleSet *ruleSet, Rule *rule, double value);
+void writeRuleFile(Rule *rule, char *alert, int length);
+void execRule(RuleSet *ruleSet, Rule *rule, double value);
+void reapHooks(RuleSet *ruleSet);
+
+const char *getMetricName(int metric) {
+  return METRIC_NAMES[metric];
+}
+
+int getMetricIndex(const char *name) {
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    if (strcmp(name, METRIC_NAMES[i]) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+
+}
+
+bool loadRules(RuleSet *ruleSet, char *path) {
+
+  ruleSet -> path = path;
+  ruleSet -> rules = NULL;
+  ruleSet -> count = 0;
+  ruleSet -> hookCount = 0;
+  ruleSet -> retiredFireCount = 0;
+
+  FILE *file = fopen(path, "r");
+
+  if (file == NULL) {
+    perror("Error loading rules... rules file cannot be opened");
+    return false;
+  }
+
+  int capacity = 0;
+  int lineNumber = 0;
+  char line[RULE_LINE_LEN];
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+
+    lineNumber++;
+
+    // strip the newline, comments, and the whitespace before them
+    int length = strcspn(line, "#\n");
+
+    while (length > 0 && (line[length - 1] == ' ' || line[length - 1] == '\t')) {
+      length--;
+    }
+
+    line[length] = '\0';
+
+    // skip blank lines
+    if (strspn(line, " \t") == length) {
+      continue;
+    }
+
+    if (ruleSet -> count == capacity) {
+
+      capacity = capacity == 0 ? 8 : capacity * 2;
+
+      Rule *rules = realloc(ruleSet -> rules, capacity * sizeof(Rule));
+
+      if (rules == NULL) {
+        perror("Error loading rules... realloc");
+        fclose(file);
+        freeRules(ruleSet);
+        return false;
+      }
+
+      ruleSet -> rules = rules;
+
+    }
+
+    if (!parseRule(&(ruleSet -> rules[ruleSet -> count]), line, lineNumber)) {
+      fclose(file);
+      freeRules(ruleSet);
+      return false;
+    }
+
+    ruleSet -> count++;
+
+  }
+
+  fclose(file);
+
+  return true;
+
+}
+
+void freeRules(RuleSet *ruleSet) {
+
+  for (int i = 0; i < ruleSet -> count; i++) {
+    if (ruleSet -> rules[i].fd != -1) {
+      close(ruleSet -> rules[i].fd);
+    }
+  }
+
+  free(ruleSet -> rules);
+
+  ruleSet -> rules = NULL;
+  ruleSet -> count = 0;
+
+}
+
+// swaps in rules loaded again from the file. rules that weren't changed carry on where they were, so
+// a condition that already fired doesn't fire again and a for window doesn't start over
+void replaceRules(RuleSet *ruleSet, RuleSet *reloaded) {
+
+  reloaded -> retiredFireCount = ruleSet -> retiredFireCount;
+
+  for (int i = 0; i < ruleSet -> count; i++) {
+
+    Rule *old = &(ruleSet -> rules[i]);
+    Rule *rule = NULL;
+
+    // the same rule can be written twice, so each new rule only takes over one old one
+    for (int j = 0; j < reloaded -> count && rule == NULL; j++) {
+      if (!reloaded -> rules[j].carried && strcmp(reloaded -> rules[j].text, old -> text) == 0) {
+        rule = &(reloaded -> rules[j]);
+      }
+    }
+
+    if (rule == NULL) {
+      reloaded -> retiredFireCount += old -> fireCount;
+      continue;
+    }
+
+    rule -> carried = true;
+    rule -> holding = old -> holding;
+    rule -> fired = old -> fired;
+    rule -> fireCount = old -> fireCount;
+    rule -> since = old -> since;
+
+    // keep the file open, so a fifo reader doesn't see it close
+    rule -> fd = old -> fd;
+    old -> fd = -1;
+
+  }
+
+  // the hooks still running belong to the new set now
+  memcpy(reloaded -> hooks, ruleSet -> hooks, ruleSet -> hookCount * sizeof(pid_t));
+  reloaded -> hookCount = ruleSet -> hookCount;
+
+  freeRules(ruleSet);
+  *ruleSet = *reloaded;
+
+}
+
+// waits up to RULE_HOOK_TIMEOUT_MS for hooks to finish, then kills whatever is left
+void stopHooks(RuleSet *ruleSet) {
+
+  struct timespec pause = {
+    .tv_sec = 0,
+    .tv_nsec = 50000000L
+  };
+
+  for (int waited = 0; ruleSet -> hookCount > 0 && waited < RULE_HOOK_TIMEOUT_MS; waited += 50) {
+    reapHooks(ruleSet);
+    nanosleep(&pause, NULL);
+  }
+
+  reapHooks(ruleSet);
+
+  for (int i = 0; i < ruleSet -> hookCount; i++) {
+
+    fprintf(stderr, "Hook %d is still running, killing it\n", ruleSet -> hooks[i]);
+
+    // each hook is its own process group, so this takes whatever the shell started too
+    kill(-ruleSet -> hooks[i], SIGKILL);
+    waitpid(ruleSet -> hooks[i], NULL, 0);
+
+  }
+
+  ruleSet -> hookCount = 0;
+
+}
+
+// a rule is "metric operator threshold [for duration] action [argument]", ie.
+// memory_percent > 90 for 30s exec /usr/local/bin/page-oncall
+bool parseRule(Rule *rule, char *line, int lineNumber) {
+
+  memset(rule, 0, sizeof(Rule));
+  rule -> fd = -1;
+
+  // keep the rule as written, without leading whitespace
+  snprintf(rule -> text, sizeof(rule -> text), "%s", line + strspn(line, " \t"));
+
+  char *save;
+  char *metric = strtok_r(line, " \t", &save);
+  char *operator = strtok_r(NULL, " \t", &save);
+  char *threshold = strtok_r(NULL, " \t", &save);
+  char *action = strtok_r(NULL, " \t", &save);
+
+  if (action == NULL) {
+    fprintf(stderr, "Error loading rules... line %d needs a metric, operator, threshold, and action\n", lineNumber);
+    return false;
+  }
+
+  rule -> metric = getMetricIndex(metric);
+
+  if (rule -> metric == -1) {
+    fprintf(stderr, "Error loading rules... line %d has an unknown metric '%s'\n", lineNumber, metric);
+    return false;
+  }
+
+  // compiled to its index, so evaluating a rule never compares strings
+  rule -> operator = -1;
+
+  for (int i = 0; i < sizeof(OPERATORS) / sizeof(OPERATORS[0]); i++) {
+    if (strcmp(operator, OPERATORS[i]) == 0) {
+      rule -> operator = i;
+    }
+  }
+
+  if (rule -> operator == -1) {
+    fprintf(stderr, "Error loading rules... line %d has an unknown operator '%s'\n", lineNumber, operator);
+    return false;
+  }
+
+  // allow a % after percentages
+  char *end;
+  rule -> threshold = strtod(threshold, &end);
+
+  if (end == threshold || (*end != '\0' && strcmp(end, "%") != 0)) {
+    fprintf(stderr, "Error loading rules... line %d has an invalid threshold '%s'\n", lineNumber, threshold);
+    return false;
+  }
+
+  if (strcmp(action, "for") == 0) {
+
+    char *duration = strtok_r(NULL, " \t", &save);
+
+    rule -> duration = duration == NULL ? -1.0 : parseDuration(duration);
+
+    if (rule -> duration < 0.0) {
+      fprintf(stderr, "Error loading rules... line %d has an invalid duration\n", lineNumber);
+      return false;
+    }
+
+    action = strtok_r(NULL, " \t", &save);
+
+    if (action == NULL) {
+      fprintf(stderr, "Error loading rules... line %d needs an action\n", lineNumber);
+      return false;
+    }
+
+  }
+
+  // the argument is the rest of the line, so commands and messages can have spaces
+  char *argument = save + strspn(save, " \t");
+
+  snprintf(rule -> argument, sizeof(rule -> argument), "%s", argument);
+
+  if (strcmp(action, "print") == 0) {
+    rule -> action = RULE_ACTION_PRINT;
+  } else if (strcmp(action, "file") == 0) {
+    rule -> action = RULE_ACTION_FILE;
+  } else if (strcmp(action, "exec") == 0) {
+    rule -> action = RULE_ACTION_EXEC;
+  } else {
+    fprintf(stderr, "Error loading rules... line %d has an unknown action '%s'\n", lineNumber, action);
+    return false;
+  }
+
+  if (rule -> action != RULE_ACTION_PRINT && rule -> argument[0] == '\0') {
+    fprintf(stderr, "Error loading rules... line %d needs a path after '%s'\n", lineNumber, action);
+    return false;
+  }
+
+  return true;
+
+}
+
+// seconds in a duration like 500ms, 30s, 5m, or 1h. no unit means seconds, -1 if invalid
+double parseDuration(char *string) {
+
+  char *unit;
+  double duration = strtod(string, &unit);
+
+  if (unit == string || duration < 0.0) {
+    return -1.0;
+  }
+
+  if (strcmp(unit, "") == 0 || strcmp(unit, "s") == 0) {
+    return duration;
+  } else if (strcmp(unit, "ms") == 0) {
+    return duration / 1000.0;
+  } else if (strcmp(unit, "m") == 0) {
+    return duration * 60.0;
+  } else if (strcmp(unit, "h") == 0) {
+    return duration * 3600.0;
+  }
+
+  return -1.0;
+
+}
+
+void evaluateRules(RuleSet *ruleSet, double *metrics, struct timespec *now) {
+
+  for (int i = 0; i < ruleSet -> count; i++) {
+
+    Rule *rule = &(ruleSet -> rules[i]);
+    double value = metrics[rule -> metric];
+
+    // a metric missing from this sample, ie. cpu during the baseline, leaves the rule as it was
+    if (isnan(value)) {
+      continue;
+    }
+
+    if (!isRuleTrue(rule, value)) {
+      // rearm once the condition clears
+      rule -> holding = false;
+      rule -> fired = false;
+      continue;
+    }
+
+    if (!rule -> holding) {
+      rule -> holding = true;
+      rule -> since = *now;
+    }
+
+    double held = (double) (now -> tv_sec - rule -> since.tv_sec) + (double) (now -> tv_nsec - rule -> since.tv_nsec) / 1000000000.0;
+
+    // only fire once each time the condition holds long enough
+    if (!rule -> fired && held >= rule -> duration) {
+      rule -> fired = true;
+      rule -> fireCount++;
+      fireRule(ruleSet, rule, value);
+    }
+
+  }
+
+  reapHooks(ruleSet);
+
+}
+
+// reaps hooks that finished, without waiting for ones still running
+void reapHooks(RuleSet *ruleSet) {
+
+  int i = 0;
+
+  while (i < ruleSet -> hookCount) {
+
+    if (waitpid(ruleSet -> hooks[i], NULL, WNOHANG) == 0) {
+      i++;
+      continue;
+    }
+
+    // finished, or somehow not ours anymore, so move the last one into its place
+    ruleSet -> hooks[i] = ruleSet -> hooks[--ruleSet -> hookCount];
+
+  }
+
+}
+
+bool isRuleTrue(Rule *rule, double value) {
+
+  switch (rule -> operator) {
+    case RULE_GREATER:
+      return value > rule -> threshold;
+    case RULE_GREATER_EQUAL:
+      return value >= rule -> threshold;
+    case RULE_LESS:
+      return value < rule -> threshold;
+    case RULE_LESS_EQUAL:
+      return value <= rule -> threshold;
+    case RULE_EQUAL:
+      return value == rule -> threshold;
+  }
+
+  return value != rule -> threshold;
+
+}
+
+void fireRule(RuleSet *ruleSet, Rule *rule, double value) {
+
+  char alert[2 * RULE_TEXT_LEN];
+
+  // print rules can have their own message, everything else uses the rule
+  char *message = rule -> action == RULE_ACTION_PRINT && rule -> argument[0] != '\0' ? rule -> argument : rule -> text;
+
+  int length = snprintf(alert, sizeof(alert), "Alert: %s (%s = %.2f)\n", message, getMetricName(rule -> metric), value);
+
+  if (length > (int) sizeof(alert) - 1) {
+    length = sizeof(alert) - 1;
+  }
+
+  if (rule -> action == RULE_ACTION_PRINT) {
+    printf("%s", alert);
+  } else if (rule -> action == RULE_ACTION_FILE) {
+    writeRuleFile(rule, alert, length);
+  } else {
+    execRule(ruleSet, rule, value);
+  }
+
+}
+
+void writeRuleFile(Rule *rule, char *alert, int length) {
+
+  // opened when first needed, since a fifo can't be opened until something reads it
+  if (rule -> fd == -1) {
+    rule -> fd = open(rule -> argument, O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK | O_CLOEXEC, 0644);
+  }
+
+  if (rule -> fd == -1) {
+    fprintf(stderr, "Error firing rule... %s cannot be opened: %s\n", rule -> argument, strerror(errno));
+    return;
+  }
+
+  // never block sampling on a full fifo, drop the alert instead
+  if (write(rule -> fd, alert, length) == -1 && errno != EAGAIN) {
+    // the reader went away, try opening it again next time
+    close(rule -> fd);
+    rule -> fd = -1;
+  }
+
+}
+
+void execRule(RuleSet *ruleSet, Rule *rule, double value) {
+
+  // a hook that never exits shouldn't be able to pile up more of itself
+  if (ruleSet -> hookCount == RULE_MAX_HOOKS) {
+    fprintf(stderr, "Error firing rule... %d hooks are still running\n", RULE_MAX_HOOKS);
+    return;
+  }
+
+  pid_t pid = fork();
+
+  if (pid == -1) {
+    perror("Error firing rule... fork");
+    return;
+  }
+
+  if (pid != 0) {
+    // here as well as in the hook, so it is in its group before we could ever kill it
+    setpgid(pid, pid);
+    ruleSet -> hooks[ruleSet -> hookCount++] = pid;
+    return;
+  }
+
+  // its own process group, so it can be killed with everything it starts
+  setpgid(0, 0);
+
+  // hook, tell it what fired through the environment
+  char valueString[64];
+  snprintf(valueString, sizeof(valueString), "%f", value);
+
+  setenv("SYSINFO_RULE", rule -> text, 1);
+  setenv("SYSINFO_METRIC", getMetricName(rule -> metric), 1);
+  setenv("SYSINFO_VALUE", valueString, 1);
+
+  // don't pass on what we ignore or block
+  sigset_t signals;
+  sigemptyset(&signals);
+
+  signal(SIGPIPE, SIG_DFL);
+  sigprocmask(SIG_SETMASK, &signals, NULL);
+
+  execl("/bin/sh", "sh", "-c", rule -> argument, (char*) NULL);
+
+  perror("Error firing rule... exec");
+  _exit(127);
+
+}
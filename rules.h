@@ -0,0 +1,51 @@
+#define RULE_TEXT_LEN 256
+
+#define RULE_ACTION_PRINT 0
+#define RULE_ACTION_FILE 1
+#define RULE_ACTION_EXEC 2
+
+// in the same order as OPERATORS in rules.c
+#define RULE_GREATER 0
+#define RULE_GREATER_EQUAL 1
+#define RULE_LESS 2
+#define RULE_LESS_EQUAL 3
+#define RULE_EQUAL 4
+#define RULE_NOT_EQUAL 5
+
+// exec hooks that can be running at once, and how long they get to finish when we stop
+#define RULE_MAX_HOOKS 64
+#define RULE_HOOK_TIMEOUT_MS 5000
+
+typedef struct rule {
+  int metric; // METRIC_* index
+  int operator; // RULE_GREATER, etc.
+  double threshold;
+  double duration; // seconds the condition has to hold before firing, 0 fires right away
+  int action;
+  char argument[RULE_TEXT_LEN]; // message, file path, or command depending on the action
+  char text[RULE_TEXT_LEN]; // the rule as written, for alerts
+  int fd; // file actions only, -1 when not open
+  bool holding;
+  bool fired;
+  int fireCount;
+  bool carried; // took over the state of a rule from before a reload
+  struct timespec since; // CLOCK_MONOTONIC when the condition started holding
+} Rule;
+
+typedef struct ruleSet {
+  char *path;
+  Rule *rules;
+  int count;
+  pid_t hooks[RULE_MAX_HOOKS]; // exec hooks still running, reaped by pid so our other children are left alone
+  int hookCount;
+  int retiredFireCount; // alerts fired by rules a reload removed, so the total survives reloads
+} RuleSet;
+
+const char *getMetricName(int metric);
+int getMetricIndex(const char *name);
+
+bool loadRules(RuleSet *ruleSet, char *path);
+void freeRules(RuleSet *ruleSet);
+void replaceRules(RuleSet *ruleSet, RuleSet *reloaded);
+void stopHooks(RuleSet *ruleSet);
+void evaluateRules(RuleSet *ruleSet, double *metrics, struct timespec *now);
@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "series.h"
+
+// the most bits one sample can take: a 4 bit timestamp header with 64 bits, then
+// for every value a 2 bit header, 5 bits of leading zeros, 6 bits of length, and 64 bits
+#define MAX_SAMPLE_BITS(values) (68 + 77 * (values))
+
+// no xor can have this many leading zeros, so the next value always starts a new window
+#define NO_WINDOW 64
+
+void writeBits(unsigned char *data, int *position, uint64_t value, int count);
+uint64_t readBits(const unsigned char *data, int *position, int count);
+int64_t signExtend(uint64_t value, int count);
+void encodeSample(SeriesBlock *block, SeriesState *state, int valueCount, int64_t time, const double *values);
+void decodeSample(SeriesBlock *block, int *bit, SeriesState *state, int valueCount, bool first, int64_t *time, double *values);
+void dropSeriesBlocks(Series *series);
+
+// timestamps are stored as the change in their delta (delta of delta), which is 0 for evenly spaced
+// samples, and values are stored as the bits that changed since the last value (xor), which is
+// nothing for values that stay the same. both use as few bits as the change needs.
+// a noisy value like 12.34 changes most of its mantissa every sample, but stored as the whole
+// number 1234.0 only its top bits change, so values are scaled to the decimals we care about
+
+void initSeries(Series *series, int valueCount, int decimals, int retention) {
+
+  memset(series, 0, sizeof(Series));
+
+  series -> valueCount = valueCount > SERIES_MAX_VALUES ? SERIES_MAX_VALUES : valueCount;
+  series -> scale = decimals < 0 ? 0.0 : pow(10.0, decimals);
+  series -> retention = retention;
+
+}
+
+void freeSeries(Series *series) {
+
+  SeriesBlock *block = series -> head;
+
+  while (block != NULL) {
+    SeriesBlock *next = block -> next;
+    free(block);
+    block = next;
+  }
+
+  int valueCount = series -> valueCount;
+  double scale = series -> scale;
+  int retention = series -> retention;
+
+  memset(series, 0, sizeof(Series));
+
+  series -> valueCount = valueCount;
+  series -> scale = scale;
+  series -> retention = retention;
+
+}
+
+bool appendSeries(Series *series, int64_t time, const double *values) {
+
+  SeriesBlock *block = series -> tail;
+
+  // start a new block when the worst case sample wouldn't fit
+  if (block == NULL || block -> bits + MAX_SAMPLE_BITS(series -> valueCount) > SERIES_BLOCK_SIZE * 8) {
+
+    block = calloc(1, sizeof(SeriesBlock));
+
+    if (block == NULL) {
+      perror("Error adding to series... calloc");
+      return false;
+    }
+
+    block -> prev = series -> tail;
+
+    if (series -> tail == NULL) {
+      series -> head = block;
+    } else {
+      series -> tail -> next = block;
+    }
+
+    series -> tail = block;
+    series -> blockCount++;
+
+  }
+
+  double scaled[SERIES_MAX_VALUES];
+
+  for (int i = 0; i < series -> valueCount; i++) {
+    scaled[i] = series -> scale == 0.0 ? values[i] : round(values[i] * series -> scale);
+  }
+
+  encodeSample(block, &(series -> state), series -> valueCount, time, scaled);
+
+  block -> count++;
+  series -> count++;
+
+  dropSeriesBlocks(series);
+
+  return true;
+
+}
+
+// frees the oldest blocks while the rest still hold the retention, so a series running for
+// weeks stays about the size of its retention plus a block
+void dropSeriesBlocks(Series *series) {
+
+  if (series -> retention <= 0) {
+    return;
+  }
+
+  while (series -> head != series -> tail && series -> count - series -> head -> count >= series -> retention) {
+
+    SeriesBlock *head = series -> head;
+
+    series -> head = head -> next;
+    series -> head -> prev = NULL;
+    series -> count -= head -> count;
+    series -> blockCount--;
+
+    free(head);
+
+  }
+
+}
+
+long getSeriesBytes(Series *series) {
+  return (long) series -> blockCount * sizeof(SeriesBlock);
+}
+
+// every sample as a line of csv, with a header of time (ms since the epoch) and the names of the values
+bool exportSeries(Series *series, const char *path, const char **names) {
+
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL) {
+    perror("Error exporting series... fopen");
+    return false;
+  }
+
+  fprintf(file, "time");
+
+  for (int i = 0; i < series -> valueCount; i++) {
+    fprintf(file, ",%s", names[i]);
+  }
+
+  fprintf(file, "\n");
+
+  // values were rounded to the scale, so print them to the same decimals
+  int decimals = series -> scale == 0.0 ? -1 : (int) round(log10(series -> scale));
+
+  SeriesReader reader;
+  initSeriesReader(&reader, series, 0);
+
+  int64_t time;
+  double values[SERIES_MAX_VALUES];
+
+  while (readSeries(&reader, &time, values)) {
+
+    fprintf(file, "%lld", (long long) time);
+
+    for (int i = 0; i < series -> valueCount; i++) {
+      if (decimals < 0) {
+        fprintf(file, ",%.17g", values[i]);
+      } else {
+        fprintf(file, ",%.*f", decimals, values[i]);
+      }
+    }
+
+    fprintf(file, "\n");
+
+  }
+
+  // a full disk only shows up once the buffer is written
+  if (fclose(file) != 0) {
+    perror("Error exporting series... fclose");
+    return false;
+  }
+
+  return true;
+
+}
+
+void initSeriesReader(SeriesReader *reader, Series *series, int start) {
+
+  reader -> series = series;
+  reader -> block = series -> tail;
+  reader -> index = 0;
+  reader -> bit = 0;
+
+  // the display only wants the last few samples, so find the block from the tail, where first is
+  // the index of the first sample of the block
+  int first = series -> count - (reader -> block != NULL ? reader -> block -> count : 0);
+
+  while (reader -> block != NULL && reader -> block -> prev != NULL && first > start) {
+    reader -> block = reader -> block -> prev;
+    first -= reader -> block -> count;
+  }
+
+  if (start >= series -> count) {
+    reader -> block = NULL;
+    return;
+  }
+
+  // then decode up to the start in its block
+  start -= first;
+
+  int64_t time;
+  double values[SERIES_MAX_VALUES];
+
+  for (int i = 0; i < start; i++) {
+    readSeries(reader, &time, values);
+  }
+
+}
+
+bool readSeries(SeriesReader *reader, int64_t *time, double *values) {
+
+  if (reader -> block != NULL && reader -> index == reader -> block -> count) {
+    reader -> block = reader -> block -> next;
+    reader -> index = 0;
+    reader -> bit = 0;
+  }
+
+  if (reader -> block == NULL) {
+    return false;
+  }
+
+  decodeSample(reader -> block, &(reader -> bit), &(reader -> state), reader -> series -> valueCount,
+               reader -> index == 0, time, values);
+
+  reader -> index++;
+
+  if (reader -> series -> scale != 0.0) {
+    for (int i = 0; i < reader -> series -> valueCount; i++) {
+      values[i] /= reader -> series -> scale;
+    }
+  }
+
+  return true;
+
+}
+
+int readSeriesColumn(Series *series, int column, double *values, int count) {
+
+  // the most recent count samples
+  if (count > series -> count) {
+    count = series -> count;
+  }
+
+  SeriesReader reader;
+  initSeriesReader(&reader, series, series -> count - count);
+
+  int64_t time;
+  double sample[SERIES_MAX_VALUES];
+
+  for (int i = 0; i < count; i++) {
+    readSeries(&reader, &time, sample);
+    values[i] = sample[column];
+  }
+
+  return count;
+
+}
+
+void encodeSample(SeriesBlock *block, SeriesState *state, int valueCount, int64_t time, const double *values) {
+
+  int *bits = &(block -> bits);
+  bool first = block -> count == 0;
+
+  if (first) {
+
+    writeBits(block -> data, bits, (uint64_t) time, 64);
+    state -> delta = 0;
+
+  } else {
+
+    int64_t delta = time - state -> time;
+    int64_t deltaOfDelta = delta - state -> delta;
+
+    if (deltaOfDelta == 0) {
+      writeBits(block -> data, bits, 0, 1);
+    } else if (deltaOfDelta >= -64 && deltaOfDelta <= 63) {
+      writeBits(block -> data, bits, 2, 2);
+      writeBits(block -> data, bits, (uint64_t) deltaOfDelta, 7);
+    } else if (deltaOfDelta >= -256 && deltaOfDelta <= 255) {
+      writeBits(block -> data, bits, 6, 3);
+      writeBits(block -> data, bits, (uint64_t) deltaOfDelta, 9);
+    } else if (deltaOfDelta >= -2048 && deltaOfDelta <= 2047) {
+      writeBits(block -> data, bits, 14, 4);
+      writeBits(block -> data, bits, (uint64_t) deltaOfDelta, 12);
+    } else {
+      writeBits(block -> data, bits, 15, 4);
+      writeBits(block -> data, bits, (uint64_t) deltaOfDelta, 64);
+    }
+
+    state -> delta = delta;
+
+  }
+
+  state -> time = time;
+
+  for (int i = 0; i < valueCount; i++) {
+
+    uint64_t value;
+    memcpy(&value, &values[i], sizeof(value));
+
+    if (first) {
+      writeBits(block -> data, bits, value, 64);
+      state -> values[i] = value;
+      state -> leading[i] = NO_WINDOW;
+      state -> trailing[i] = 0;
+      continue;
+    }
+
+    uint64_t xor = value ^ state -> values[i];
+    state -> values[i] = value;
+
+    if (xor == 0) {
+      writeBits(block -> data, bits, 0, 1);
+      continue;
+    }
+
+    int leading = __builtin_clzll(xor);
+    int trailing = __builtin_ctzll(xor);
+
+    // leading zeros only get 5 bits
+    if (leading > 31) {
+      leading = 31;
+    }
+
+    if (leading >= state -> leading[i] && trailing >= state -> trailing[i]) {
+
+      // fits in the same window as the last value, so only write the bits in it
+      int length = 64 - state -> leading[i] - state -> trailing[i];
+
+      writeBits(block -> data, bits, 2, 2);
+      writeBits(block -> data, bits, xor >> state -> trailing[i], length);
+
+    } else {
+
+      int length = 64 - leading - trailing;
+
+      // length is 1 to 64, stored as 0 to 63
+      writeBits(block -> data, bits, 3, 2);
+      writeBits(block -> data, bits, leading, 5);
+      writeBits(block -> data, bits, length - 1, 6);
+      writeBits(block -> data, bits, xor >> trailing, length);
+
+      state -> leading[i] = leading;
+      state -> trailing[i] = trailing;
+
+    }
+
+  }
+
+}
+
+void decodeSample(SeriesBlock *block, int *bit, SeriesState *state, int valueCount, bool first, int64_t *time, double *values) {
+
+  if (first) {
+
+    state -> time = (int64_t) readBits(block -> data, bit, 64);
+    state -> delta = 0;
+
+  } else {
+
+    // count the 1s before the first 0, up to 4
+    int header = 0;
+
+    while (header < 4 && readBits(block -> data, bit, 1) == 1) {
+      header++;
+    }
+
+    int64_t deltaOfDelta = 0;
+
+    if (header == 1) {
+      deltaOfDelta = signExtend(readBits(block -> data, bit, 7), 7);
+    } else if (header == 2) {
+      deltaOfDelta = signExtend(readBits(block -> data, bit, 9), 9);
+    } else if (header == 3) {
+      deltaOfDelta = signExtend(readBits(block -> data, bit, 12), 12);
+    } else if (header == 4) {
+      deltaOfDelta = (int64_t) readBits(block -> data, bit, 64);
+    }
+
+    state -> delta += deltaOfDelta;
+    state -> time += state -> delta;
+
+  }
+
+  *time = state -> time;
+
+  for (int i = 0; i < valueCount; i++) {
+
+    if (first) {
+
+      state -> values[i] = readBits(block -> data, bit, 64);
+      state -> leading[i] = NO_WINDOW;
+      state -> trailing[i] = 0;
+
+    } else if (readBits(block -> data, bit, 1) == 1) {
+
+      if (readBits(block -> data, bit, 1) == 1) {
+        state -> leading[i] = readBits(block -> data, bit, 5);
+        state -> trailing[i] = 64 - state -> leading[i] - ((int) readBits(block -> data, bit, 6) + 1);
+      }
+
+      int length = 64 - state -> leading[i] - state -> trailing[i];
+
+      state -> values[i] ^= readBits(block -> data, bit, length) << state -> trailing[i];
+
+    }
+
+    memcpy(&values[i], &(state -> values[i]), sizeof(double));
+
+  }
+
+}
+
+void writeBits(unsigned char *data, int *position, uint64_t value, int count) {
+
+  // most significant bit first, up to a byte at a time
+  while (count > 0) {
+
+    int space = 8 - (*position & 7);
+    int take = count < space ? count : space;
+
+    unsigned int chunk = (unsigned int) (value >> (count - take)) & ((1u << take) - 1);
+
+    data[*position >> 3] |= chunk << (space - take);
+
+    *position += take;
+    count -= take;
+
+  }
+
+}
+
+uint64_t readBits(const unsigned char *data, int *position, int count) {
+
+  uint64_t value = 0;
+
+  while (count > 0) {
+
+    int space = 8 - (*position & 7);
+    int take = count < space ? count : space;
+
+    unsigned int chunk = (data[*position >> 3] >> (space - take)) & ((1u << take) - 1);
+
+    value = (value << take) | chunk;
+
+    *position += take;
+    count -= take;
+
+  }
+
+  return value;
+
+}
+
+int64_t signExtend(uint64_t value, int count) {
+  return (int64_t) (value << (64 - count)) >> (64 - count);
+}
@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+// bytes of encoded samples in each block, a block can be decoded without the ones before it
+#define SERIES_BLOCK_SIZE 4096
+#define SERIES_MAX_VALUES 16
+
+typedef struct seriesBlock {
+  struct seriesBlock *next;
+  struct seriesBlock *prev; // so the most recent samples can be found from the tail
+  int count; // samples in this block
+  int bits; // bits of data used
+  unsigned char data[SERIES_BLOCK_SIZE];
+} SeriesBlock;
+
+// what the next sample is encoded against, the encoder and decoder keep the same state
+typedef struct seriesState {
+  int64_t time;
+  int64_t delta;
+  uint64_t values[SERIES_MAX_VALUES];
+  int leading[SERIES_MAX_VALUES];
+  int trailing[SERIES_MAX_VALUES];
+} SeriesState;
+
+typedef struct series {
+  int valueCount; // values in every sample
+  double scale; // values are rounded to 1 / scale, 0 keeps them exact
+  int retention; // the fewest samples kept, older whole blocks are freed past it. 0 keeps everything
+  int count; // samples in every block
+  int blockCount;
+  SeriesBlock *head;
+  SeriesBlock *tail;
+  SeriesState state;
+} Series;
+
+typedef struct seriesReader {
+  Series *series;
+  SeriesBlock *block;
+  int index; // of the next sample in the block
+  int bit;
+  SeriesState state;
+} SeriesReader;
+
+void initSeries(Series *series, int valueCount, int decimals, int retention);
+void freeSeries(Series *series);
+bool appendSeries(Series *series, int64_t time, const double *values);
+long getSeriesBytes(Series *series);
+bool exportSeries(Series *series, const char *path, const char **names);
+
+void initSeriesReader(SeriesReader *reader, Series *series, int start);
+bool readSeries(SeriesReader *reader, int64_t *time, double *values);
+int readSeriesColumn(Series *series, int column, double *values, int count);
@@ -5,99 +5,364 @@
 #include <sys/sysinfo.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
+#include <time.h>
+#include "process_info.h"
+#include "frame.h"
 #include "stats_functions.h"
+#include "graphics.h"
+#include "series.h"
+#include "accounting.h"
+#include "frequency.h"
 
-#define MAX_STRING_LEN 4096
-
+// smallest change in memory in GB drawn as one character
 #define RAM_GRAPHICS_SCALE 0.1
-#define CPU_GRAPHICS_SCALE 2.0
 
-void getUserUsage(char[MAX_STRING_LEN]);
-void getMemoryUsage(char[MAX_STRING_LEN], int graphics, int sampleSize, int sampleCount, char history[sampleSize][256], double historyRam[sampleSize]);
-void getCPUUsage(char string[MAX_STRING_LEN], int graphics, int* lastTotalTime, int* lastIdleTime, int sampleSize, int sampleCount, char history[sampleSize][256]);
-double getUsagePercent(int totalTime, int idleTime);
-void getCPUTimes(int *totalTime, int *idleTime);
+// room kept after a bar for its value, ie. " -12.34" or " 100.00%"
+#define GRAPHICS_SUFFIX_LEN 12
+
+// a full row of sparkline characters, 3 bytes each
+#define SPARKLINE_CAPACITY 1024
+#define TREND_SAMPLES ((SPARKLINE_CAPACITY - 16) / 3)
+
+// the most recent samples shown in each history, and the most bytes one row can be
+#define HISTORY_ROWS 30
+#define HISTORY_LINE_LEN 256
+
+// the fewest samples each history keeps, a day at 1 sample a second. older blocks are freed
+#define HISTORY_RETENTION 86400
+#define HISTORY_PATH_LEN 4096
+
+// users shown in the per user table, busiest first
+#define TOP_USERS 10
+
+// values kept in the memory history, in GB to 3 decimals
+#define MEMORY_USED 0
+#define MEMORY_TOTAL 1
+#define VIRTUAL_USED 2
+#define VIRTUAL_TOTAL 3
+#define MEMORY_SERIES_VALUES 4
+#define MEMORY_SERIES_DECIMALS 3
+
+// values kept in the cpu history, usage followed by the breakdown, in percent to 2 decimals
+#define CPU_USAGE 0
+#define CPU_BREAKDOWN 1
+#define CPU_SERIES_VALUES 10
+#define CPU_SERIES_DECIMALS 2
+
+// columns of the cpu line in /proc/stat, in order
+#define CPU_USER 0
+#define CPU_NICE 1
+#define CPU_SYSTEM 2
+#define CPU_IDLE 3
+#define CPU_IOWAIT 4
+#define CPU_IRQ 5
+#define CPU_SOFTIRQ 6
+#define CPU_STEAL 7
+#define CPU_GUEST 8
+#define CPU_GUEST_NICE 9
+#define CPU_STATE_COUNT 10
+
+// states shown in the breakdown, guest_nice is folded into guest
+#define CPU_BREAKDOWN_COUNT 9
+
+typedef struct cpuTimes {
+  unsigned long long states[CPU_STATE_COUNT]; // jiffies since boot, 64 bit so they don't overflow on long uptimes
+} CPUTimes;
+
+int getUserUsage(Frame *frame, Accounting *accounting);
+void getMemoryUsage(Frame *frame, int graphics, Series *history, struct timespec *timestamp, double metrics[METRIC_COUNT]);
+void renderMemoryRow(Frame *frame, int graphics, double *values, double *lastValues);
+void getCPUUsage(Frame *frame, int graphics, CPUTimes *lastTimes, Frequency *frequency, Series *history, struct timespec *timestamp, double metrics[METRIC_COUNT]);
+void getCPUFrequency(Frame *frame, Frequency *frequency, double metrics[METRIC_COUNT]);
+void renderCPURow(Frame *frame, double *values);
+void renderTrend(Frame *frame, Series *history, int column, bool fixed, double min, double max);
+void exportHistory(Series *history, const char *name, const char **names);
+double getUsagePercent(unsigned long long totalTime, unsigned long long idleTime);
+double getCPUBreakdown(CPUTimes *lastTimes, CPUTimes *times, double breakdown[CPU_BREAKDOWN_COUNT]);
+void getCPUTimes(CPUTimes *times);
 int getNumCPUCores();
+void initSampleHeader(SampleHeader *header);
+int64_t getMilliseconds(struct timespec *time);
+
+// columns of the histories when they are exported, named like the metrics
+const char *MEMORY_SERIES_NAMES[MEMORY_SERIES_VALUES] = {
+  "memory_used", "memory_total", "virtual_used", "virtual_total"
+};
+
+const char *CPU_SERIES_NAMES[CPU_SERIES_VALUES] = {
+  "cpu_usage", "cpu_user", "cpu_nice", "cpu_system", "cpu_idle", "cpu_iowait", "cpu_irq", "cpu_softirq", "cpu_steal", "cpu_guest"
+};
+
+// where the histories are written when the processes exit, NULL to not write them. set before
+// forking, so every process has it
+char *historyPrefix = NULL;
+
+const char *CPU_BREAKDOWN_NAMES[CPU_BREAKDOWN_COUNT] = {
+  "user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal", "guest"
+};
+
+// graphics character for each state in the stacked bar, idle is left out
+const char CPU_BREAKDOWN_KEYS[CPU_BREAKDOWN_COUNT] = {
+  '#', '+', '=', '\0', 'w', 'i', 's', '!', 'g'
+};
+
+void handleReportUsers(int *flags, int pipes[2], int ticks) {
+
+  Accounting accounting;
+
+  // without /proc we can still list the sessions
+  bool accounted = initAccounting(&accounting);
 
-void handleReportUsers(int *flags, int pipes[2]) {
+  // every sample is built in the same frame
+  Frame frame;
+  initFrame(&frame);
 
-  int samples = flags[4];
-  int tdelay = flags[5]; 
+  Tick tick;
 
-  for (int i = 0; i < samples; i++) {
+  // sample every time the parent ticks, until it closes the tick pipe
+  while (readTick(ticks, &tick)) {
 
-    char string[MAX_STRING_LEN] = "";
+    resetFrame(&frame);
 
-    getUserUsage(string);
+    SampleHeader header;
+    initSampleHeader(&header);
 
-    write(pipes[1], string, MAX_STRING_LEN);
+    header.metrics[METRIC_USERS] = getUserUsage(&frame, accounted ? &accounting : NULL);
 
-    sleep(tdelay);
+    writeSample(pipes[1], &header, &frame);
 
   }
 
   endutent();
 
+  freeFrame(&frame);
+
+  if (accounted) {
+    freeAccounting(&accounting);
+  }
+
 }
 
-void handleReportMemory(int *flags, int pipes[2]) {
+void handleReportMemory(int *flags, int pipes[2], int ticks) {
 
   int graphics = flags[2];
-  int samples = flags[4];
-  int tdelay = flags[5];
 
-  char memoryStringHistory[samples][256];
-  double memoryUsageHistory[samples];
+  Series memoryHistory;
+  initSeries(&memoryHistory, MEMORY_SERIES_VALUES, MEMORY_SERIES_DECIMALS, HISTORY_RETENTION);
+
+  Frame frame;
+  initFrame(&frame);
+
+  Tick tick;
+
+  while (readTick(ticks, &tick)) {
+
+    resetFrame(&frame);
+
+    // once a sample is cheap, and picks up a resized terminal
+    if (graphics == 1) {
+      updateTerminalWidth();
+    }
 
-  for (int i = 0; i < samples; i++) {
+    SampleHeader header;
+    initSampleHeader(&header);
 
-    char string[MAX_STRING_LEN] = "";
+    getMemoryUsage(&frame, graphics, &memoryHistory, &header.timestamp, header.metrics);
 
-    getMemoryUsage(string, graphics, samples, i + 1, memoryStringHistory, memoryUsageHistory);
+    writeSample(pipes[1], &header, &frame);
 
-    write(pipes[1], string, MAX_STRING_LEN);
-    sleep(tdelay);
   }
 
+  exportHistory(&memoryHistory, "memory", MEMORY_SERIES_NAMES);
+
+  freeFrame(&frame);
+  freeSeries(&memoryHistory);
+
 }
 
-void handleReportCPU(int *flags, int pipes[2]) {
+void handleReportCPU(int *flags, int pipes[2], int ticks) {
 
   int graphics = flags[2];
-  int samples = flags[4];
-  int tdelay = flags[5];
 
-  int totalTime;
-  int idleTime;
+  CPUTimes lastTimes;
+
+  // kept open for every sample, NULL if /sys couldn't be read
+  Frequency frequency;
+  Frequency *frequencyPointer = initFrequency(&frequency) ? &frequency : NULL;
+
+  Series cpuHistory;
+  initSeries(&cpuHistory, CPU_SERIES_VALUES, CPU_SERIES_DECIMALS, HISTORY_RETENTION);
+
+  Frame frame;
+  initFrame(&frame);
 
-  char cpuStringHistory[samples - 1][256];
+  Tick tick;
 
-  for (int i = 0; i < samples; i++) {
+  while (readTick(ticks, &tick)) {
 
-    char string[MAX_STRING_LEN] = "";
+    resetFrame(&frame);
 
-    if (i == 0) {
+    // once a sample is cheap, and picks up a resized terminal
+    if (graphics == 1) {
+      updateTerminalWidth();
+    }
+
+    SampleHeader header;
+    initSampleHeader(&header);
+
+    if (tick.sampleNumber == 1) {
       // grab baseline
-      getCPUTimes(&totalTime, &idleTime);
+      getCPUTimes(&lastTimes);
 
-      strcpy(string, "----------CPU-Usage-------------------\n");
+      appendString(&frame, "----------CPU-Usage-------------------\n");
  
-      char cpuCores[64];
-      snprintf(cpuCores, sizeof(cpuCores), "Number of CPU Cores: %d\n", getNumCPUCores());
-      strncat(string, cpuCores, (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
+      appendString(&frame, "Number of CPU Cores: ");
+      appendInt(&frame, getNumCPUCores());
+      appendChar(&frame, '\n');
+
+      // frequency and temperature don't need a baseline, only the throttle counts do
+      getCPUFrequency(&frame, frequencyPointer, header.metrics);
 
-      char* end = "Grabbing baseline sample for usage next sample...\n--------------------------------------\n"; 
-      strncat(string, end, (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
+      appendString(&frame, "Grabbing baseline sample for usage next sample...\n--------------------------------------\n");
 
     } else {
-      getCPUUsage(string, graphics, &totalTime, &idleTime, samples, i + 1, cpuStringHistory);
+      getCPUUsage(&frame, graphics, &lastTimes, frequencyPointer, &cpuHistory, &header.timestamp, header.metrics);
+    }
+
+    writeSample(pipes[1], &header, &frame);
+
+  }
+
+  if (frequencyPointer != NULL) {
+    freeFrequency(frequencyPointer);
+  }
+
+  exportHistory(&cpuHistory, "cpu", CPU_SERIES_NAMES);
+
+  freeFrame(&frame);
+  freeSeries(&cpuHistory);
+
+}
+
+void initSampleHeader(SampleHeader *header) {
+
+  // timestamp as close to reading the values as we can
+  clock_gettime(CLOCK_REALTIME, &(header -> timestamp));
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    header -> metrics[i] = NAN;
+  }
+
+  header -> length = 0;
+
+}
+
+int64_t getMilliseconds(struct timespec *time) {
+  return (int64_t) time -> tv_sec * 1000 + time -> tv_nsec / 1000000;
+}
+
+int readFull(int fd, void *buffer, int length) {
+
+  int total = 0;
+
+  // pipes can return less than asked for, or be interrupted by a signal
+  while (total < length) {
+
+    ssize_t count = read(fd, (char*) buffer + total, length - total);
+
+    if (count == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (count <= 0) {
+      break;
+    }
+
+    total += count;
+
+  }
+
+  return total;
+
+}
+
+int writeFull(int fd, const void *buffer, int length) {
+
+  int total = 0;
+
+  while (total < length) {
+
+    ssize_t count = write(fd, (const char*) buffer + total, length - total);
+
+    if (count == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (count <= 0) {
+      break;
     }
 
-    write(pipes[1], string, MAX_STRING_LEN);
+    total += count;
 
-    sleep(tdelay);
   }
 
+  return total;
+
+}
+
+bool readTick(int fd, Tick *tick) {
+  // fails once the parent closes its end
+  return readFull(fd, tick, sizeof(Tick)) == sizeof(Tick);
+}
+
+bool readSample(int fd, SampleHeader *header, Frame *frame) {
+
+  resetFrame(frame);
+
+  if (readFull(fd, header, sizeof(SampleHeader)) != sizeof(SampleHeader) || header -> length < 0) {
+    return false;
+  }
+
+  // the frame grows to fit the sample, up to FRAME_MAX_SIZE
+  int length = header -> length < FRAME_MAX_SIZE - 1 ? header -> length : FRAME_MAX_SIZE - 1;
+  char *cursor = reserveFrame(frame, length);
+
+  if (cursor == NULL || readFull(fd, cursor, length) != length) {
+    return false;
+  }
+
+  commitFrame(frame, length);
+
+  // throw away whatever didn't fit so the next header lines up
+  for (int remaining = header -> length - length; remaining > 0; ) {
+
+    char discard[256];
+    int count = readFull(fd, discard, remaining < (int) sizeof(discard) ? remaining : (int) sizeof(discard));
+
+    if (count <= 0) {
+      return false;
+    }
+
+    remaining -= count;
+
+  }
+
+  return true;
+
+}
+
+bool writeSample(int fd, SampleHeader *header, Frame *frame) {
+
+  // the text is as long as the frame, without its \0
+  header -> length = frame -> length;
+
+  if (writeFull(fd, header, sizeof(SampleHeader)) != sizeof(SampleHeader)) {
+    return false;
+  }
+
+  return writeFull(fd, frame -> data, header -> length) == header -> length;
+
 }
 
 int getCurrentProcessUsage() {
@@ -122,9 +387,45 @@ int getCurrentProcessUsage() {
 
 }
 
-void getUserUsage(char string[MAX_STRING_LEN]) {
+// counts from /proc/<pid>/status, a voluntary switch is the process waiting and an involuntary one is it being preempted
+bool getContextSwitches(pid_t pid, long *voluntary, long *involuntary) {
+
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", (int) pid);
+
+  FILE *status = fopen(path, "r");
+
+  if (status == NULL) {
+    return false;
+  }
+
+  char line[256];
+  int found = 0;
 
-  strcpy(string, "----------Users-----------------------\n");
+  // they are the last two lines, so read until both have been seen
+  while (found < 2 && fgets(line, sizeof(line), status) != NULL) {
+    if (sscanf(line, "voluntary_ctxt_switches: %ld", voluntary) == 1 ||
+        sscanf(line, "nonvoluntary_ctxt_switches: %ld", involuntary) == 1) {
+      found++;
+    }
+  }
+
+  fclose(status);
+
+  return found == 2;
+
+}
+
+int getUserUsage(Frame *frame, Accounting *accounting) {
+
+  appendString(frame, "----------Users-----------------------\n");
+
+  int count = 0;
+
+  // every process is counted before the sessions are joined to their users
+  if (accounting != NULL) {
+    updateAccounting(accounting);
+  }
 
   // reset pointer
   setutent();
@@ -140,35 +441,93 @@ void getUserUsage(char string[MAX_STRING_LEN]) {
       continue;
     }
 
-    char *user = userEntry -> ut_user;
-    char *device = userEntry -> ut_line;
-    char *host = userEntry -> ut_host;
+    // utmp fields aren't always terminated when they are full
+    char user[sizeof(userEntry -> ut_user) + 1];
+    int userLength = strnlen(userEntry -> ut_user, sizeof(userEntry -> ut_user));
+
+    memcpy(user, userEntry -> ut_user, userLength);
+    user[userLength] = '\0';
+
+    // format and print the user
+    appendString(frame, user);
+    appendString(frame, "    ");
+    appendBytes(frame, userEntry -> ut_line, strnlen(userEntry -> ut_line, sizeof(userEntry -> ut_line)));
+    appendString(frame, " (");
 
     // if host is blank, assume it is local
-    if (strcmp(host, "") == 0) {
-      strcpy(host, "local");
+    if (userEntry -> ut_host[0] == '\0') {
+      appendString(frame, "local");
+    } else {
+      appendBytes(frame, userEntry -> ut_host, strnlen(userEntry -> ut_host, sizeof(userEntry -> ut_host)));
     }
 
-    char entry[512];
-    snprintf(entry, sizeof(entry), "%s    %s (%s) \n", user, device, host);
+    appendString(frame, ") \n");
 
-    strncat(string, entry, (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
-       
-    // format and print the user
+    if (accounting != NULL) {
+      addAccountingSession(accounting, user);
+    }
+
+    count++;
 
     userEntry = getutent();
   }
 
-  char* end = "--------------------------------------\n"; 
+  if (accounting != NULL) {
+
+    UserSlot *top[TOP_USERS];
+    int topCount = getTopUsers(accounting, top, TOP_USERS);
+
+    appendString(frame, "----------Usage-By-User---------------\n");
+    appendString(frame, "User              Procs    CPU%      Memory  Sessions\n");
+
+    for (int i = 0; i < topCount; i++) {
+
+      // columns line up under the headings, names are cut off at 16
+      int start = frame -> length;
+      appendBytes(frame, top[i] -> name, strnlen(top[i] -> name, 16));
+      alignFrame(frame, start, -17);
+
+      start = frame -> length;
+      appendInt(frame, top[i] -> processes);
+      alignFrame(frame, start, 6);
+      appendChar(frame, ' ');
+
+      // the first pass is the baseline for cpu time, like the cpu usage
+      start = frame -> length;
+
+      if (accounting -> pass == 1) {
+        appendString(frame, "--");
+      } else {
+        appendDouble(frame, top[i] -> cpu, 2);
+      }
+
+      alignFrame(frame, start, 7);
+      appendChar(frame, ' ');
+
+      start = frame -> length;
+      appendDouble(frame, (double) top[i] -> rss / 1000000.0, 2);
+      alignFrame(frame, start, 8);
+      appendString(frame, " GB ");
+
+      start = frame -> length;
+      appendInt(frame, top[i] -> sessions);
+      alignFrame(frame, start, 9);
+      appendChar(frame, '\n');
+
+    }
+
+  }
 
-  strncat(string, end, (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
+  appendString(frame, "--------------------------------------\n");
+
+  return count;
 
 }
 
 
-void getMemoryUsage(char string[MAX_STRING_LEN], int graphics, int sampleSize, int sampleCount, char history[sampleSize][256], double historyRam[sampleSize]) {
+void getMemoryUsage(Frame *frame, int graphics, Series *history, struct timespec *timestamp, double metrics[METRIC_COUNT]) {
 
-  strcpy(string, "----------Memory-Usage----------------\n");
+  appendString(frame, "----------Memory-Usage----------------\n");
 
   // create the buffer
   struct sysinfo memory;
@@ -188,123 +547,342 @@ void getMemoryUsage(char string[MAX_STRING_LEN], int graphics, int sampleSize, i
   double usedRam = totalRam - ((double) memory.freeram) / toGB; 
   double usedVirtualRam = totalVirtualRam - ((double) (memory.freeram + memory.freeswap)) / toGB;
 
-  snprintf(history[sampleCount - 1], sizeof(history[sampleCount - 1]), "Physical: %.2f GB / %.2f GB       Virtual: %.2f GB / %.2f GB       ", usedRam, totalRam, usedVirtualRam, totalVirtualRam);
+  metrics[METRIC_MEMORY_USED] = usedRam;
+  metrics[METRIC_MEMORY_TOTAL] = totalRam;
+  metrics[METRIC_MEMORY_PERCENT] = usedRam / totalRam * 100.0;
+  metrics[METRIC_VIRTUAL_USED] = usedVirtualRam;
+  metrics[METRIC_VIRTUAL_TOTAL] = totalVirtualRam;
 
-  if (graphics == 1) {
+  double values[MEMORY_SERIES_VALUES] = {usedRam, totalRam, usedVirtualRam, totalVirtualRam};
 
-    int maxGraphicsLength = (int) (totalRam / RAM_GRAPHICS_SCALE) + 5;
+  appendSeries(history, getMilliseconds(timestamp), values);
 
-    char graphicsLine[maxGraphicsLength];
-    historyRam[sampleCount - 1] = usedRam;
+  // only the most recent rows, starting a row early if we can so the first one has a delta
+  int start = history -> count > HISTORY_ROWS ? history -> count - HISTORY_ROWS : 0;
 
-    // initialize the string
-    strcpy(graphicsLine, "|");
+  SeriesReader reader;
+  initSeriesReader(&reader, history, start > 0 ? start - 1 : 0);
 
-    // check if first entry
-    if (sampleCount == 1) {
-      strcat(graphicsLine, "*");
-    } else {
+  int64_t time;
+  double lastValues[MEMORY_SERIES_VALUES];
 
-      double lastEntry = historyRam[sampleCount - 2];
-      double ramDelta = usedRam - lastEntry;
+  if (start > 0) {
+    readSeries(&reader, &time, lastValues);
+  }
 
-      double deltaAbsolute = fabs(ramDelta);
+  bool first = start == 0;
 
-      for (double i = 0.0; i < deltaAbsolute; i += RAM_GRAPHICS_SCALE) {
+  while (readSeries(&reader, &time, values)) {
 
-        // concatenate characters based on increase/decrease
-        if (ramDelta < 0) {
-          strcat(graphicsLine, ":");
-        } else {
-          strcat(graphicsLine, "#");
-        }
+    renderMemoryRow(frame, graphics, values, first ? NULL : lastValues);
+    appendChar(frame, '\n');
 
-      }
+    memcpy(lastValues, values, sizeof(values));
+    first = false;
 
-      if(ramDelta < 0) {
-        strcat(graphicsLine, "@");
-      } else {
-        strcat(graphicsLine, "*");
-      }
+  }
 
-      char delta[10];
-      
-      snprintf(delta, sizeof(delta), " %.2f", ramDelta);
+  if (graphics == 1) {
+    // trend of the samples that fit on one row, scaled to their own min and max
+    renderTrend(frame, history, MEMORY_USED, false, 0.0, 0.0);
+  }
 
-      strncat(graphicsLine, delta, (maxGraphicsLength - strlen(graphicsLine) - 1) * sizeof(char));
+  appendString(frame, "--------------------------------------\n");
 
-    }
+}
+
+void renderMemoryRow(Frame *frame, int graphics, double *values, double *lastValues) {
 
-    strncat(history[sampleCount - 1], graphicsLine, 256);
+  int start = frame -> length;
+
+  double usedRam = values[MEMORY_USED];
+  double totalRam = values[MEMORY_TOTAL];
+
+  appendString(frame, "Physical: ");
+  appendDouble(frame, usedRam, 2);
+  appendString(frame, " GB / ");
+  appendDouble(frame, totalRam, 2);
+  appendString(frame, " GB       Virtual: ");
+  appendDouble(frame, values[VIRTUAL_USED], 2);
+  appendString(frame, " GB / ");
+  appendDouble(frame, values[VIRTUAL_TOTAL], 2);
+  appendString(frame, " GB       ");
+
+  if (graphics == 0) {
+    return;
   }
 
-  for (int i = 0; i < sampleCount; i++) {
-    strncat(string, history[i], (MAX_STRING_LEN - strlen(string) - 2) * sizeof(char));
-    strncat(string, "\n", (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
+  appendChar(frame, '|');
+
+  // check if first entry
+  if (lastValues == NULL) {
+    appendChar(frame, '*');
+    return;
   }
 
-  char* end = "--------------------------------------\n"; 
+  int length = frame -> length - start;
+
+  double ramDelta = usedRam - lastValues[MEMORY_USED];
+
+  // a unit is RAM_GRAPHICS_SCALE, unless changing all of ram at that scale wouldn't fit the terminal,
+  // and the row never goes past HISTORY_LINE_LEN with the delta after the bar
+  int width = getGraphicsWidth(length + GRAPHICS_SUFFIX_LEN, HISTORY_LINE_LEN - length - GRAPHICS_SUFFIX_LEN);
+  double scale = fmax(RAM_GRAPHICS_SCALE, totalRam / width);
+
+  int units = (int) ceil(fabs(ramDelta) / scale);
 
-  strncat(string, end, (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
+  // characters based on increase/decrease
+  appendRepeat(frame, ramDelta < 0 ? ':' : '#', units < width ? units : width);
+
+  appendChar(frame, ramDelta < 0 ? '@' : '*');
+  appendChar(frame, ' ');
+  appendDouble(frame, ramDelta, 2);
 
 }
 
-void getCPUUsage(char string[MAX_STRING_LEN], int graphics, int* lastTotalTime, int* lastIdleTime, int sampleSize, int sampleCount, char history[sampleSize][256]) {
+void getCPUUsage(Frame *frame, int graphics, CPUTimes *lastTimes, Frequency *frequency, Series *history, struct timespec *timestamp, double metrics[METRIC_COUNT]) {
 
-  strcpy(string, "----------CPU-Usage-------------------\n");
+  appendString(frame, "----------CPU-Usage-------------------\n");
 
-  char cpuCores[64];
-  snprintf(cpuCores, sizeof(cpuCores), "Number of CPU Cores: %d\n", getNumCPUCores());
-  strncat(string, cpuCores, (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
- 
-  int totalTime;
-  int idleTime;
+  appendString(frame, "Number of CPU Cores: ");
+  appendInt(frame, getNumCPUCores());
+  appendChar(frame, '\n');
+
+  CPUTimes times;
+
+  getCPUTimes(&times);
 
-  getCPUTimes(&totalTime, &idleTime);
+  double breakdown[CPU_BREAKDOWN_COUNT];
+  double usagePercent = getCPUBreakdown(lastTimes, &times, breakdown);
 
-  int totalTimeDelta = totalTime - *lastTotalTime;
-  int idleTimeDelta = idleTime - *lastIdleTime;
-  double usagePercent = getUsagePercent(totalTimeDelta, idleTimeDelta);
+  *lastTimes = times;
+
+  metrics[METRIC_CPU_USAGE] = usagePercent;
+
+  for (int i = 0; i < CPU_BREAKDOWN_COUNT; i++) {
+    metrics[METRIC_CPU_USER + i] = breakdown[i];
+  }
+
+  appendString(frame, "CPU Usage: ");
+  appendDouble(frame, usagePercent, 2);
+  appendString(frame, "%\n");
+
+  // split the breakdown over two lines so it fits in a normal terminal
+  for (int i = 0; i < CPU_BREAKDOWN_COUNT; i++) {
+
+    appendString(frame, CPU_BREAKDOWN_NAMES[i]);
+    appendChar(frame, ' ');
+    appendDouble(frame, breakdown[i], 2);
+    appendString(frame, (i == CPU_IOWAIT || i == CPU_BREAKDOWN_COUNT - 1) ? "%\n" : "%  ");
+
+  }
 
-  *lastTotalTime = totalTime;
-  *lastIdleTime = idleTime;
+  getCPUFrequency(frame, frequency, metrics);
 
-  char cpuUsageString[256];
-  snprintf(cpuUsageString, sizeof(cpuUsageString), "CPU Usage: %.2f%%\n", usagePercent);
-  strncat(string, cpuUsageString, (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
+  double values[CPU_SERIES_VALUES];
+
+  values[CPU_USAGE] = usagePercent;
+  memcpy(values + CPU_BREAKDOWN, breakdown, sizeof(breakdown));
+
+  appendSeries(history, getMilliseconds(timestamp), values);
 
   if (graphics == 1) {
 
-    int maxGraphicsLength = (int) (100 / CPU_GRAPHICS_SCALE) + 5;
+    double values[CPU_SERIES_VALUES];
+    int64_t time;
+
+    SeriesReader reader;
+    initSeriesReader(&reader, history, history -> count > HISTORY_ROWS ? history -> count - HISTORY_ROWS : 0);
+
+    while (readSeries(&reader, &time, values)) {
+      renderCPURow(frame, values);
+      appendChar(frame, '\n');
+    }
+
+    // trend of the samples that fit on one row, always out of 100%
+    renderTrend(frame, history, CPU_USAGE, true, 0.0, 100.0);
+
+  }
+
+  appendString(frame, "--------------------------------------\n");
+
+}
+
+// a row for every socket, and the temperature of every thermal zone, whichever this machine has
+void getCPUFrequency(Frame *frame, Frequency *frequency, double metrics[METRIC_COUNT]) {
+
+  if (frequency == NULL) {
+    return;
+  }
+
+  updateFrequency(frequency);
+
+  int cpus = 0;
+  int throttled = 0;
+  bool throttles = false;
+  double sum = 0.0;
 
-    char graphicsLine[maxGraphicsLength];
+  for (int i = 0; i < frequency -> socketCount; i++) {
 
-    // initialize string
-    strncpy(graphicsLine, "|", maxGraphicsLength * sizeof(char));
+    FrequencySocket *socket = &(frequency -> sockets[i]);
 
-    for (double i = 0.0; i < usagePercent; i += CPU_GRAPHICS_SCALE) {
-      // for every unit of scale, concatenate a | character
-      strncat(graphicsLine, "|", (maxGraphicsLength - strlen(graphicsLine) - 1) * sizeof(char));
+    cpus += socket -> cpus;
+    sum += socket -> sum;
+    throttled += socket -> throttled;
+
+    appendString(frame, "Socket ");
+    appendInt(frame, socket -> package);
+
+    if (socket -> cpus > 0) {
+      appendString(frame, " Frequency: ");
+      appendDouble(frame, socket -> min, 0);
+      appendString(frame, " / ");
+      appendDouble(frame, socket -> sum / socket -> cpus, 0);
+      appendString(frame, " / ");
+      appendDouble(frame, socket -> max, 0);
+      appendString(frame, " MHz (min / avg / max)");
+    } else {
+      appendString(frame, " Frequency: unknown");
     }
 
-    char usageString[10];
+    // only intel has the counters, and they need a pass to compare with
+    if (socket -> throttleFd != -1 && frequency -> pass > 1) {
+
+      throttles = true;
+
+      appendString(frame, ", throttled ");
+      appendInt(frame, socket -> throttled);
+      appendString(frame, " cpus, package ");
+      appendInt(frame, socket -> packageThrottled);
+      appendString(frame, " times");
+
+    }
+
+    appendChar(frame, '\n');
+
+  }
+
+  if (cpus > 0) {
+    metrics[METRIC_CPU_FREQUENCY] = sum / cpus;
+  }
+
+  if (throttles) {
+    metrics[METRIC_CPU_THROTTLED] = throttled;
+  }
+
+  if (frequency -> zoneCount == 0) {
+    return;
+  }
 
-    snprintf(usageString, sizeof(usageString), " %.2f%%", usagePercent);
+  appendString(frame, "Temperature:");
 
-    strncat(graphicsLine, usageString, (maxGraphicsLength - strlen(graphicsLine) - 1) * sizeof(char));
+  for (int i = 0; i < frequency -> zoneCount; i++) {
 
-    strncpy(history[sampleCount - 2], graphicsLine, sizeof(history[sampleCount - 2]));
+    ThermalZone *zone = &(frequency -> zones[i]);
 
-    for (int i = 0; i < sampleCount - 1; i++) {
-      strncat(string, history[i], (MAX_STRING_LEN - strlen(string) - 2) * sizeof(char));
-      strncat(string, "\n", (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
+    appendString(frame, i == 0 ? " " : ", ");
+    appendString(frame, zone -> type);
+    appendChar(frame, ' ');
+
+    if (isnan(zone -> temperature)) {
+      appendString(frame, "unknown");
+      continue;
+    }
+
+    appendDouble(frame, zone -> temperature, 1);
+    appendString(frame, " C");
+
+    // the hottest of the cpu's own zones is what gets throttled first, the others are only shown
+    if (zone -> cpu && (isnan(metrics[METRIC_CPU_TEMPERATURE]) || zone -> temperature > metrics[METRIC_CPU_TEMPERATURE])) {
+      metrics[METRIC_CPU_TEMPERATURE] = zone -> temperature;
+    }
+
+  }
+
+  appendChar(frame, '\n');
+
+}
+
+void renderCPURow(Frame *frame, double *values) {
+
+  // 100% fills whatever is left of the terminal, but no finer than 1% per character
+  int width = getGraphicsWidth(GRAPHICS_SUFFIX_LEN + 1, 100);
+  double scale = 100.0 / width;
+
+  appendChar(frame, '|');
+
+  // idle is left out of the stacked bar
+  int capacity = HISTORY_LINE_LEN - 1 - GRAPHICS_SUFFIX_LEN;
+  char *bar = reserveFrame(frame, capacity);
+
+  if (bar != NULL) {
+    commitFrame(frame, renderStackedBar(bar, capacity, values + CPU_BREAKDOWN, CPU_BREAKDOWN_KEYS, CPU_BREAKDOWN_COUNT, scale));
+  }
+
+  appendChar(frame, ' ');
+  appendDouble(frame, values[CPU_USAGE], 2);
+  appendChar(frame, '%');
+
+}
+
+// a sparkline of the samples that fit on one row, between min and max unless they should be the samples' own
+void renderTrend(Frame *frame, Series *history, int column, bool fixed, double min, double max) {
+
+  char *prefix = "Trend: ";
+
+  appendString(frame, prefix);
+
+  double window[TREND_SAMPLES];
+  int count = readSeriesColumn(history, column, window, getGraphicsWidth(strlen(prefix), TREND_SAMPLES));
+
+  if (!fixed && count > 0) {
+
+    min = window[0];
+    max = window[0];
+
+    for (int i = 1; i < count; i++) {
+      min = fmin(min, window[i]);
+      max = fmax(max, window[i]);
     }
 
   }
 
-  char* end = "--------------------------------------\n"; 
+  char *sparkline = reserveFrame(frame, SPARKLINE_CAPACITY);
+
+  if (sparkline != NULL) {
+    commitFrame(frame, renderSparkline(sparkline, SPARKLINE_CAPACITY, window, count, min, max));
+  }
+
+  appendChar(frame, '\n');
+
+  // what the history is costing us
+  appendString(frame, "History: ");
+  appendInt(frame, history -> count);
+  appendString(frame, " samples in ");
+  appendInt(frame, getSeriesBytes(history) / 1024);
+  appendString(frame, " kB\n");
+
+}
+
+void setHistoryExport(char *prefix) {
+  historyPrefix = prefix;
+}
+
+// writes a history to <prefix>.<name>.csv if --history was given
+void exportHistory(Series *history, const char *name, const char **names) {
+
+  if (historyPrefix == NULL) {
+    return;
+  }
+
+  char path[HISTORY_PATH_LEN];
+
+  if (snprintf(path, sizeof(path), "%s.%s.csv", historyPrefix, name) >= (int) sizeof(path)) {
+    fprintf(stderr, "Error exporting history... path is too long\n");
+    return;
+  }
 
-  strncat(string, end, (MAX_STRING_LEN - strlen(string) - 1) * sizeof(char));
+  exportSeries(history, path, names);
 
 }
 
@@ -333,8 +911,10 @@ int getNumCPUCores() {
 
 }
 
-void getCPUTimes(int *totalTime, int *idleTime) {
- 
+void getCPUTimes(CPUTimes *times) {
+
+  memset(times, 0, sizeof(CPUTimes));
+
   FILE *stat = fopen("/proc/stat", "r");
 
   if (stat == NULL) {
@@ -342,46 +922,79 @@ void getCPUTimes(int *totalTime, int *idleTime) {
     return;
   }
 
-  int currentTotalTime = 0;
-  int currentIdleTime = 0;
+  // the first line is the aggregate of all cpus, room for 10 64 bit columns
+  char line[512];
 
-  char cpu[10];
+  // make sure file is formatted how we want
+  if (fgets(line, sizeof(line), stat) == NULL || strncmp(line, "cpu ", 4) != 0) {
+    fprintf(stderr, "Error Fetching CPU Usage... /proc/stat formatted incorrectly\n");
+    fclose(stat);
+    return;
+  }
 
-  fscanf(stat, "%s", cpu);
+  char *current = line + 3;
 
-  // make sure file is formatted how we want
+  // older kernels have fewer columns, anything missing stays 0
+  for (int i = 0; i < CPU_STATE_COUNT; i++) {
+
+    char *next;
+    unsigned long long time = strtoull(current, &next, 10);
+
+    if (next == current) {
+      break;
+    }
+
+    times -> states[i] = time;
+    current = next;
 
-  if (strcmp(cpu, "cpu") != 0) {
-    perror("Error Fetching CPU Usage... /proc/stat formatted incorrectly");
-    return;
   }
 
-  for (int i = 0; i < 7; i++) {
+  fclose(stat);
 
-    int time;
+}
 
-    // proceed to get the next 7 columns
-    fscanf(stat, "%d", &time);
+double getCPUBreakdown(CPUTimes *lastTimes, CPUTimes *times, double breakdown[CPU_BREAKDOWN_COUNT]) {
 
-    currentTotalTime += time;
+  unsigned long long deltas[CPU_STATE_COUNT];
 
-    if (i == 3) {
-      // idle is the 4th column
-      currentIdleTime = time;
+  for (int i = 0; i < CPU_STATE_COUNT; i++) {
+    // counters can go backwards when a cpu is hotplugged, treat that as no time passing
+    if (times -> states[i] > lastTimes -> states[i]) {
+      deltas[i] = times -> states[i] - lastTimes -> states[i];
+    } else {
+      deltas[i] = 0;
     }
+  }
+
+  // guest time is already counted inside user and nice, so split it out instead of adding it
+  unsigned long long guest = deltas[CPU_GUEST] + deltas[CPU_GUEST_NICE];
 
+  deltas[CPU_USER] -= deltas[CPU_GUEST] < deltas[CPU_USER] ? deltas[CPU_GUEST] : deltas[CPU_USER];
+  deltas[CPU_NICE] -= deltas[CPU_GUEST_NICE] < deltas[CPU_NICE] ? deltas[CPU_GUEST_NICE] : deltas[CPU_NICE];
+  deltas[CPU_GUEST] = guest;
+
+  unsigned long long totalTime = 0;
+
+  for (int i = 0; i < CPU_BREAKDOWN_COUNT; i++) {
+    totalTime += deltas[i];
   }
 
-  *totalTime = currentTotalTime;
-  *idleTime = currentIdleTime;
+  for (int i = 0; i < CPU_BREAKDOWN_COUNT; i++) {
+    breakdown[i] = totalTime == 0 ? 0.0 : ((double) deltas[i]) / ((double) totalTime) * 100.0;
+  }
 
-  fclose(stat);
+  return getUsagePercent(totalTime, deltas[CPU_IDLE]);
 
 }
 
-double getUsagePercent(int totalTime, int idleTime) {
+double getUsagePercent(unsigned long long totalTime, unsigned long long idleTime) {
+
+  // no time has passed since the last sample
+  if (totalTime == 0) {
+    return 0.0;
+  }
+
   // turn the total time and idle time into a usage percent
   // note, this is equivalent to the equation given in the a3 handout and is taken directly from my a1
-  return (1.0 - ((double) idleTime) / ((double) totalTime)) * 100.0; 
+  return (1.0 - ((double) idleTime) / ((double) totalTime)) * 100.0;
 }
-
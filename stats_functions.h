@@ -1,6 +1,13 @@
-
-void handleReportUsers(int*, int[2]);
-void handleReportMemory(int*, int[2]);
-void handleReportCPU(int*, int[2]);
+void handleReportUsers(int*, int[2], int);
+void handleReportMemory(int*, int[2], int);
+void handleReportCPU(int*, int[2], int);
 int getCurrentProcessUsage();
+void setHistoryExport(char*);
+bool getContextSwitches(pid_t, long*, long*);
 
+// pipes
+int readFull(int, void*, int);
+int writeFull(int, const void*, int);
+bool readTick(int, Tick*);
+bool readSample(int, SampleHeader*, Frame*);
+bool writeSample(int, SampleHeader*, Frame*);